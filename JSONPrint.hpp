@@ -105,7 +105,8 @@ class JSONPrint {
     vector<XmlElement*> children = elem->children;
 
     /* put the children in alphabetical order */
-    sort(children.begin(), children.end());
+    sort(children.begin(), children.end()
+	 , [](XmlElement *a, XmlElement *b) { return *a < *b; });
 
     /* see if the element has content  */
     if( elem->have_contentP() 
@@ -17,6 +17,7 @@
 
 #include "./grammar/utility.hpp"
 #include "./grammar/Singleton.hpp"
+#include "./grammar/Checkpoint.hpp"
 /**
  * @internal
  * non-instantiable class used for template parametrization.
@@ -241,6 +242,40 @@ public:
    * @return # of children
    */
   int count_children() { return children.size(); }
+
+  /**
+   * write this element, but not its children, to a checkpoint (see grammar::Parser::save_checkpoint)
+   * @param out stream to write to
+   */
+  void save(std::ostream &out) const {
+    using namespace grammar;
+    checkpoint::write(out, tag_name_);
+    checkpoint::write(out, content_);
+    checkpoint::write(out, std::uint64_t(line_number_));
+    checkpoint::write(out, attributes_.size());
+    for(auto &attribute : attributes_) {
+      checkpoint::write(out, attribute.get_name());
+      checkpoint::write(out, attribute.get_value());
+    }
+  }
+
+  /**
+   * read an element written by save
+   * @param in stream to read from
+   * @return the element, without children
+   */
+  static XmlElement* load(std::istream &in) {
+    using namespace grammar;
+    XmlElement *elem = new XmlElement;
+    elem->tag_name_ = checkpoint::read_string(in);
+    elem->content_ = checkpoint::read_string(in); /* already escaped */
+    elem->line_number_ = checkpoint::read_number(in);
+    for(std::uint64_t n = checkpoint::read_number(in); n; --n) {
+      std::string name = checkpoint::read_string(in);
+      elem->attributes_.push_back( XmlAttribute(name, checkpoint::read_string(in)) );
+    }
+    return elem;
+  }
 };
 
 /****************************** helper classes ******************************/
@@ -8,6 +8,7 @@
 
 #include <vector>
 #include <string>
+#include <unordered_map>
 
 #include "./XmlElement.hpp"
 #include "./XmlStats.hpp"
@@ -24,14 +25,47 @@ class debug_xml_parsing;
  * meant to facilitate stack interaction
  */
 class XmlSemanticAction {
+  /**
+   * an element closed since the last checkpoint, with the ids which place it in the tree (see save)
+   */
+  struct Closed {
+    XmlElement *elem;
+    std::uint64_t id, parent;	/**< parent is 0 for the root */
+  };
+
   //! structure containing currently open XmlElements 
   std::vector<XmlElement*> stack_;
+  std::vector<std::uint64_t> ids_; /**< id of each element of stack_ */
+  std::uint64_t next_id_;	   /**< id for the next element opened */
   
   XmlElement *result_; 		/**< when the root tag closes, put it here so I can reference it */
   int line_count_; 	        /**< current input line, as reported by line_end() */
   XmlStats stats_;		/**< tracks some statiscs on XmlElements defined with this action */
+  bool checkpointing_;		/**< keep closed_ (see checkpointing) */
+  std::vector<Closed> closed_;	/**< elements closed since the last save */
+
+  /* pop the top element, and add it to the one below (or make it the result) */
+  void pop() {
+    XmlElement *tmp = stack_.back();
+    std::uint64_t id = ids_.back();
+    stack_.pop_back();
+    ids_.pop_back();
+
+    /* log some stats on the element I just closed */
+    stats_.analyze(tmp);
+  
+    /* keep the last element in the stack so I can retrieve it */
+    if( stack_.empty() ) {
+      result_ = tmp;
+    }
+    else {
+      stack_.back()->push_child(tmp);
+    }
+
+    if(checkpointing_) closed_.push_back( Closed{tmp, id, ids_.empty() ? 0 : ids_.back()} );
+  }
 public:
-  XmlSemanticAction() : line_count_(1) {}
+  XmlSemanticAction() : next_id_(1), result_(nullptr), line_count_(1), checkpointing_(false) {}
   
   XmlElement* top() { return stack_.back(); }
   XmlElement* get_result() { return result_; }
@@ -53,6 +87,7 @@ public:
   void on_open(const std::string& name) {
     using namespace std;
     stack_.push_back(new XmlElement(line_count_,name));
+    ids_.push_back(next_id_++);
 
     if( grammar::RunVerbose<debug_xml_parsing>::P() ) {
       cout << "  ***     Parser: " << this << endl;
@@ -67,8 +102,6 @@ public:
   //! action to take when I've got a close tag
   void close(const std::string& name) {
     using namespace std;
-    XmlElement *tmp; 		/* take the top element then re-push it as a child of the next node down.  This'll hold
-				   the value between the pop and push */
     if(grammar::RunVerbose<debug_xml_parsing>::P() ) {
       cout << "  ***     Parser:" << this << "\n";
       cout << "  ***closing tag: " << name << endl;
@@ -81,19 +114,7 @@ public:
     if(stack_.back()->get_tag_name() != name)
       throw XmlException( string("Unbalanced open/close tags: got ").append(name).append(" expected ").append(stack_.back()->get_tag_name() ));
 
-    tmp = stack_.back();
-    stack_.pop_back();
-
-    /* log some stats on the element I just closed */
-    stats_.analyze(tmp);
-  
-    /* keep the last element in the stack so I can retrieve it */
-    if( stack_.empty() ) {
-      result_ = tmp;
-    }
-    else {
-      stack_.back()->push_child(tmp);
-    }
+    pop();
   }
 
   //! action to take when I've got content
@@ -129,10 +150,6 @@ public:
   void on_self_close() {
     using namespace std;
     std::string name = stack_.back()->get_tag_name();
-    XmlElement *tmp;
-				   
-    tmp = stack_.back();
-    stack_.pop_back();
 
     if(grammar::RunVerbose<debug_xml_parsing>::P() ) {
       cout << "  ***self closing tag: " << name << endl;
@@ -142,17 +159,7 @@ public:
       cout << endl;
     }  
 
-
-    /* log some stats on the element I just closed */
-    stats_.analyze(tmp);
-  
-    /* keep the last element in the stack so I can retrieve it */
-    if( stack_.empty() ) {
-      result_ = tmp;
-    }
-    else {
-      stack_.back()->push_child(tmp);
-    }
+    pop();
   }
   
   /**
@@ -160,6 +167,86 @@ public:
    */
   void line_end() { ++line_count_; }
 
+  /**
+   * keep track of the elements closed between checkpoints, for save (off by default)
+   */
+  void checkpointing(bool on) {
+    checkpointing_ = on;
+    closed_.clear();
+  }
+
+  /**
+   * write my state to a checkpoint, for grammar::Parser::save_checkpoint's hook.  The elements closed since the last
+   * save are appended to log, each once, with ids which place it in the tree; the checkpoint gets the open elements
+   * (without their children), the line count, the stats and how far log runs.  So a checkpoint's cost follows what
+   * changed since the last one, not the size of the document.
+   *
+   * @param out the checkpoint
+   * @param log the elements closed so far (needs checkpointing(true) from the start)
+   */
+  void save(std::ostream &out, std::ostream &log) {
+    using namespace grammar;
+    for(auto &closed : closed_) {
+      checkpoint::write(log, closed.id);
+      checkpoint::write(log, closed.parent);
+      closed.elem->save(log);
+    }
+    closed_.clear();
+    log.flush();
+
+    checkpoint::write(out, std::uint64_t( log.tellp() ));
+    checkpoint::write(out, std::uint64_t(line_count_));
+    checkpoint::write(out, next_id_);
+    checkpoint::write(out, stack_.size());
+    for(std::size_t i = 0; i < stack_.size(); ++i) {
+      checkpoint::write(out, ids_[i]);
+      stack_[i]->save(out);
+    }
+    stats_.save(out);
+  }
+
+  /**
+   * pick up the state saved by save, in place of mine, rebuilding the tree from log; leaves log just past what the
+   * checkpoint covers (anything after that was written after the checkpoint, and is to be written over)
+   */
+  void load(std::istream &in, std::istream &log) {
+    using namespace grammar;
+    std::uint64_t logged = checkpoint::read_number(in);
+    line_count_ = checkpoint::read_number(in);
+    next_id_ = checkpoint::read_number(in);
+    stack_.clear();
+    ids_.clear();
+    std::unordered_map<std::uint64_t, XmlElement*> open;
+    for(std::uint64_t n = checkpoint::read_number(in); n; --n) {
+      ids_.push_back( checkpoint::read_number(in) );
+      stack_.push_back( XmlElement::load(in) );
+      open[ids_.back()] = stack_.back();
+    }
+    stats_.load(in);
+
+    /* an element closes after its children, so its children are waiting for it when it comes */
+    std::unordered_map<std::uint64_t, XmlElement::ElementContainer> waiting;
+    result_ = nullptr;
+    log.seekg(0);
+    while( std::uint64_t( log.tellg() ) < logged ) {
+      std::uint64_t id = checkpoint::read_number(log), parent = checkpoint::read_number(log);
+      XmlElement *elem = XmlElement::load(log);
+
+      auto children = waiting.find(id);
+      if( children != waiting.end() ) {
+	elem->children.swap(children->second);
+	waiting.erase(children);
+      }
+
+      auto at = open.find(parent);
+      if(!parent) result_ = elem;
+      else if( at != open.end() ) at->second->push_child(elem);
+      else waiting[parent].push_back(elem);
+    }
+    if( !log || !waiting.empty() ) throw std::runtime_error("checkpoint's element log doesn't match it");
+    closed_.clear();
+  }
+
   void print_report() {
     using namespace std;
     stats_.print_report();
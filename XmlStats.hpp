@@ -26,6 +26,32 @@ public:
     ++(child_count_distribution_[elem->count_children()]);
   }
   
+  /**
+   * write the counts to a checkpoint (see grammar::Parser::save_checkpoint)
+   */
+  void save(std::ostream &out) const {
+    for(auto distribution : { &attribute_count_distribution_, &child_count_distribution_ }) {
+      grammar::checkpoint::write(out, distribution->size());
+      for(auto &count : *distribution) {
+	grammar::checkpoint::write(out, std::uint64_t(count.first));
+	grammar::checkpoint::write(out, std::uint64_t(count.second));
+      }
+    }
+  }
+
+  /**
+   * read counts written by save, in place of mine
+   */
+  void load(std::istream &in) {
+    for(auto distribution : { &attribute_count_distribution_, &child_count_distribution_ }) {
+      distribution->clear();
+      for(std::uint64_t n = grammar::checkpoint::read_number(in); n; --n) {
+	int key = grammar::checkpoint::read_number(in);
+	(*distribution)[key] = grammar::checkpoint::read_number(in);
+      }
+    }
+  }
+  
   void print_report(std::ostream& out) {
     using namespace std;
     map<int,int>::iterator itr;
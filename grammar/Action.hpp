@@ -0,0 +1,143 @@
+#ifndef GRAMMAR_ACTION_HPP
+#define GRAMMAR_ACTION_HPP
+/**
+ * @file grammar/Action.hpp
+ *
+ * A type erased callable for semantic actions.  It replaces std::function in the Rules: small callables (bound member
+ * functions, lambdas capturing a few references) are stored in place, and a call is a single indirect jump into a
+ * function instantiated for the stored type.
+ */
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace grammar {
+  template<class Signature> class Action;
+
+  /**
+   * type erased callable with a small in-place buffer.  Callables which don't fit the buffer are kept on the heap, but are
+   * still called through the same single indirection.
+   *
+   * @tparam R return type
+   * @tparam Args argument types
+   */
+  template<class R, class... Args>
+  class Action<R (Args...)> {
+  public:
+    static const std::size_t buffer_size = 4 * sizeof(void*); /**< callables up to this size are stored in place */
+  private:
+    enum Operation { copy_op, destroy_op };
+
+    typedef R (*invoke_type)(void*, Args...);
+    typedef void (*manage_type)(Operation, void*, const void*);
+
+    /** the buffer holds F itself when it fits, else a F* */
+    template<class F>
+    struct stored_locally {
+      static const bool value = sizeof(F) <= buffer_size
+	&& alignof(F) <= alignof(void*)
+	&& std::is_nothrow_copy_constructible<F>::value;
+    };
+
+    alignas(void*) unsigned char _buffer[buffer_size];
+    invoke_type _invoke;	/**< calls the stored callable */
+    manage_type _manage;	/**< copies or destroys the stored callable */
+
+    template<class F>
+    static R invoke_local(void *buf, Args... args) {
+      return (*static_cast<F*>(buf))(std::forward<Args>(args)...);
+    }
+
+    template<class F>
+    static R invoke_heap(void *buf, Args... args) {
+      return (**static_cast<F**>(buf))(std::forward<Args>(args)...);
+    }
+
+    template<class F>
+    static void manage_local(Operation op, void *dest, const void *src) {
+      if(op == copy_op) new (dest) F( *static_cast<const F*>(src) );
+      else static_cast<F*>(dest)->~F();
+    }
+
+    template<class F>
+    static void manage_heap(Operation op, void *dest, const void *src) {
+      if(op == copy_op) *static_cast<F**>(dest) = new F( **static_cast<F* const*>(src) );
+      else delete *static_cast<F**>(dest);
+    }
+
+    template<class F>
+    typename std::enable_if<stored_locally<typename std::decay<F>::type>::value>::type store(F &&fn) {
+      typedef typename std::decay<F>::type value_type;
+      new (_buffer) value_type( std::forward<F>(fn) );
+      _invoke = &invoke_local<value_type>;
+      _manage = &manage_local<value_type>;
+    }
+
+    template<class F>
+    typename std::enable_if<!stored_locally<typename std::decay<F>::type>::value>::type store(F &&fn) {
+      typedef typename std::decay<F>::type value_type;
+      *reinterpret_cast<value_type**>(_buffer) = new value_type( std::forward<F>(fn) );
+      _invoke = &invoke_heap<value_type>;
+      _manage = &manage_heap<value_type>;
+    }
+
+    void clear() {
+      if(_manage) _manage(destroy_op, _buffer, nullptr);
+      _invoke = nullptr;
+      _manage = nullptr;
+    }
+  public:
+    /**
+     * construct empty
+     */
+    Action() : _invoke(nullptr), _manage(nullptr) {}
+    Action(std::nullptr_t) : _invoke(nullptr), _manage(nullptr) {}
+
+    /**
+     * wrap a callable
+     * @param fn callable with a signature compatible with R(Args...)
+     */
+    template<class F
+	     , class = typename std::enable_if<!std::is_same<typename std::decay<F>::type, Action>::value>::type>
+    Action(F &&fn) : _invoke(nullptr), _manage(nullptr) {
+      store( std::forward<F>(fn) );
+    }
+
+    Action(const Action &orig) : _invoke(orig._invoke), _manage(orig._manage) {
+      if(_manage) _manage(copy_op, _buffer, orig._buffer);
+    }
+
+    ~Action() { clear(); }
+
+    Action& operator=(const Action &src) {
+      if(&src != this) {
+	clear();
+	if(src._manage) src._manage(copy_op, _buffer, src._buffer);
+	_invoke = src._invoke;
+	_manage = src._manage;
+      }
+      return *this;
+    }
+
+    Action& operator=(std::nullptr_t) {
+      clear();
+      return *this;
+    }
+
+    /**
+     * true if a callable is stored
+     */
+    explicit operator bool() const { return _invoke != nullptr; }
+
+    /**
+     * call the stored callable
+     */
+    R operator()(Args... args) const {
+      return _invoke(const_cast<unsigned char*>(_buffer), std::forward<Args>(args)...);
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,217 @@
+#ifndef GRAMMAR_ASYNCPARSER_HPP
+#define GRAMMAR_ASYNCPARSER_HPP
+/**
+ * @file grammar/AsyncParser.hpp
+ *
+ * Drives a Parser from a non-blocking input source with C++20 coroutines: the parser is suspended whenever it wants
+ * more input, and resumed when the next chunk arrives, without a thread blocked on the stream or lines being assembled
+ * first.  Includes an epoll event loop (Linux) and a source reading a non-blocking file descriptor (a pipe or socket).
+ *
+ * Needs a compiler with coroutines (-std=c++20); otherwise this header is empty.
+ */
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <coroutine>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+#include "./Parser.hpp"
+
+namespace grammar {
+  /**
+   * the coroutine type of parse_async.  It starts running straight away, and runs until its source first has nothing
+   * to read; after that the event loop resumes it.
+   */
+  class ParseTask {
+  public:
+    class promise_type {
+    public:
+      std::exception_ptr error;	/**< thrown by the parser, kept for get() */
+
+      ParseTask get_return_object() {
+	return ParseTask( std::coroutine_handle<promise_type>::from_promise(*this) );
+      }
+      std::suspend_never initial_suspend() noexcept { return {}; }
+      std::suspend_always final_suspend() noexcept { return {}; }
+      void return_void() {}
+      void unhandled_exception() { error = std::current_exception(); }
+    };
+  private:
+    std::coroutine_handle<promise_type> _handle;
+
+    explicit ParseTask(std::coroutine_handle<promise_type> h) : _handle(h) {}
+  public:
+    ParseTask(ParseTask &&t) : _handle(t._handle) { t._handle = nullptr; }
+    ParseTask(const ParseTask&) = delete;
+    ~ParseTask() { if(_handle) _handle.destroy(); }
+
+    /**
+     * @return true once the source is exhausted (or the parser threw)
+     */
+    bool done() const { return _handle.done(); }
+
+    /**
+     * rethrow anything the parser threw (SyntaxError and so on)
+     */
+    void get() const {
+      if(_handle.done() && _handle.promise().error) std::rethrow_exception( _handle.promise().error );
+    }
+  };
+
+#ifdef __linux__
+  /**
+   * Waits for file descriptors to become readable and resumes the coroutines waiting on them.  One thread runs the loop
+   * for any number of streams.
+   */
+  class EventLoop {
+    int _epoll;
+    std::unordered_map<int, std::coroutine_handle<> > _waiting; /**< coroutine waiting on each descriptor */
+  public:
+    EventLoop() : _epoll( epoll_create1(0) ) {
+      if(_epoll < 0) throw std::runtime_error( std::string("EventLoop: epoll_create1: ").append( std::strerror(errno) ) );
+    }
+    EventLoop(const EventLoop&) = delete;
+    ~EventLoop() { close(_epoll); }
+
+    /**
+     * resume h the next time fd is readable (or closed)
+     */
+    void wait_readable(int fd, std::coroutine_handle<> h) {
+      epoll_event ev;
+      ev.events = EPOLLIN | EPOLLONESHOT;
+      ev.data.fd = fd;
+      if( epoll_ctl(_epoll, EPOLL_CTL_MOD, fd, &ev) < 0
+	  && (errno != ENOENT || epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &ev) < 0) )
+	throw std::runtime_error( std::string("EventLoop: epoll_ctl: ").append( std::strerror(errno) ) );
+      _waiting[fd] = h;
+    }
+
+    /**
+     * stop watching fd (before closing it)
+     */
+    void forget(int fd) {
+      epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, nullptr);
+      _waiting.erase(fd);
+    }
+
+    /**
+     * @return the number of coroutines waiting
+     */
+    std::size_t waiting() const { return _waiting.size(); }
+
+    /**
+     * wait for ready descriptors once and resume their coroutines
+     *
+     * @param timeout_ms as for epoll_wait (-1 to wait as long as it takes)
+     * @return the number resumed
+     */
+    std::size_t run_once(int timeout_ms = -1) {
+      epoll_event events[64];
+      int n = epoll_wait(_epoll, events, 64, timeout_ms);
+      if(n < 0) {
+	if(errno == EINTR) return 0;
+	throw std::runtime_error( std::string("EventLoop: epoll_wait: ").append( std::strerror(errno) ) );
+      }
+
+      for(int i = 0; i < n; ++i) {
+	auto found = _waiting.find(events[i].data.fd);
+	if(found == _waiting.end()) continue;
+	std::coroutine_handle<> h = found->second;
+	_waiting.erase(found);
+	h.resume();
+      }
+      return n;
+    }
+
+    /**
+     * resume coroutines until none are waiting
+     */
+    void run() { while( !_waiting.empty() ) run_once(); }
+  };
+
+  /**
+   * chunks read from a non-blocking file descriptor, as they arrive.  The descriptor isn't closed by the source.
+   */
+  class FdSource {
+    int _fd;
+    EventLoop &_loop;
+    std::size_t _chunk;		/**< most characters read at once */
+
+    /* append what can be read to buffer; 1 if something was, 0 at end of stream, -1 if nothing is there yet */
+    int read_into(std::string &buffer) {
+      std::size_t old = buffer.size();
+      buffer.resize(old + _chunk);
+      ssize_t n;
+      do n = ::read(_fd, &buffer[old], _chunk); while(n < 0 && errno == EINTR);
+      buffer.resize(old + (n > 0 ? n : 0));
+
+      if(n > 0) return 1;
+      if(n == 0) return 0;
+      if(errno == EAGAIN || errno == EWOULDBLOCK) return -1;
+      throw std::runtime_error( std::string("FdSource: read: ").append( std::strerror(errno) ) );
+    }
+  public:
+    /**
+     * @param fd a descriptor opened with O_NONBLOCK
+     * @param loop resumes readers when fd is readable
+     * @param chunk most characters to read at once
+     */
+    FdSource(int fd, EventLoop &loop, std::size_t chunk = 4096) : _fd(fd), _loop(loop), _chunk(chunk) {}
+
+    /**
+     * awaitable result of read
+     */
+    class Read {
+      FdSource &_source;
+      std::string &_buffer;
+      int _result;
+    public:
+      Read(FdSource &s, std::string &b) : _source(s), _buffer(b), _result(-1) {}
+
+      bool await_ready() { return (_result = _source.read_into(_buffer)) >= 0; }
+      void await_suspend(std::coroutine_handle<> h) { _source._loop.wait_readable(_source._fd, h); }
+      bool await_resume() {
+	if(_result < 0) _result = _source.read_into(_buffer); /* after a spurious wakeup there may be nothing new */
+	return _result != 0;
+      }
+    };
+
+    /**
+     * co_await read(buffer) appends the next chunk to buffer, suspending until there is one
+     *
+     * @return (when awaited) false at the end of the stream; true otherwise, though rarely with nothing appended
+     */
+    Read read(std::string &buffer) { return Read(*this, buffer); }
+  };
+#endif
+
+  /**
+   * parse everything source produces.  Source has a read(std::string&) whose result is awaited to append the next
+   * chunk to the string, true until the end of the stream (like FdSource).  Chunks go to Parser::push, so they needn't
+   * be lines.
+   *
+   * @param parse the parser, which has to outlive the task
+   * @param source the input, which has to outlive the task
+   */
+  template<class Source>
+  ParseTask parse_async(Parser &parse, Source &source) {
+    std::string buffer;
+    while( co_await source.read(buffer) )
+      parse.push(buffer);
+    parse.push(buffer, false);	/* take the tokens waiting on the end of the stream */
+  }
+}
+
+#endif
+#endif
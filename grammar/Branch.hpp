@@ -6,10 +6,16 @@
  *  Created on Sunday 30 2012  
  */
 
+#include <atomic>
 #include <vector>
 #include <utility>
+#include <memory>
+#include <algorithm>
 
 #include "./Pattern.hpp"
+#include "./RegexAtoms.hpp"
+#include "./Until.hpp"
+#include "./Scan.hpp"
 #include "./Rule.hpp"
 #include "./SimpleGetSetDefault.hpp"
 #include "./SyntaxError.hpp"
@@ -24,6 +30,11 @@ namespace grammar {
     virtual Rule* operator()(Match &scanned, std::string &input, bool &more_chars_) {
       return get_default();
     }
+
+    /**
+     * becomes the always taken case of branch (defined with Branch)
+     */
+    bool add_as_case(Branch *branch);
   };
   
   /**
@@ -36,6 +47,26 @@ namespace grammar {
     /**
      * Simple data type, tells branch how to make a match and which rule to use with it 
      */
+    class Factored;
+
+    /**
+     * a count which Parsers on several threads may bump at once (rules are shared by GrammarSlot and the thread pools):
+     * relaxed atomic increments, copied by value
+     */
+    class HitCount {
+      std::atomic<std::size_t> _n;
+    public:
+      HitCount(std::size_t n = 0) : _n(n) {}
+      HitCount(const HitCount &other) : _n( std::size_t(other) ) {}
+      HitCount& operator=(const HitCount &other) { return *this = std::size_t(other); }
+      HitCount& operator=(std::size_t n) {
+	_n.store(n, std::memory_order_relaxed);
+	return *this;
+      }
+      operator std::size_t() const { return _n.load(std::memory_order_relaxed); }
+      void operator++() { _n.fetch_add(1, std::memory_order_relaxed); }
+    };
+
     class TestAndScan {
     public:
       /* Pattern *meta_char_; */
@@ -43,10 +74,324 @@ namespace grammar {
       /* todo: the regex match works differently; get rid of do_capture */
       bool do_capture;		/**< if true, save the matched string, otherwise discard it. */
       Rule *rule;		/**< rule this pattern implies*/
+      std::shared_ptr<Factored> factored; /**< if set, pattern is a prefix shared by the cases in factored */
+      std::size_t index;	/**< position of the case as written (see number_cases) */
+      HitCount hits;		/**< times this case has been chosen */
+      RegexAtoms::CharSet first; /**< bytes a match may begin with (if first_known) */
+      bool first_known;		/**< first is exact, so no case with disjoint first bytes can match in the same place */
+
+      TestAndScan() : pattern(nullptr), do_capture(true), rule(nullptr), index(-1), hits(0), first_known(false) {}
     };
     
     typedef std::vector<TestAndScan > match_vec_type;
     match_vec_type match_rules_;
+
+    /**
+     * a run of sibling cases which begin with the same (anchored) prefix.  The prefix is matched once, then the rest of
+     * each case is tried, in order, from the end of the prefix.
+     *
+     * @see Branch::factor_prefixes
+     */
+    class Factored {
+    public:
+      match_vec_type cases;	/**< the cases with the prefix removed (may themselves be factored) */
+      match_vec_type originals;	/**< the cases as they were written */
+
+      /**
+       * match prefix at offset, then the first case which follows it.
+       *
+       * @param prefix the shared prefix
+       * @param m the match (its input is the Branch's input)
+       * @param offset where the prefix has to begin
+       * @return the case which matched, or nullptr
+       */
+      TestAndScan* find(Pattern *prefix, Match &m, std::size_t offset) {
+	if( !prefix->find_at(m, offset) ) return nullptr;
+	std::size_t at = offset + m.match.position(std::size_t(0)) + m.match.length(0);
+
+	for(auto &ts : cases) {
+	  TestAndScan *found = nullptr;
+	  if(ts.factored) found = ts.factored->find(ts.pattern, m, at);
+	  else if( ts.pattern->find_at(m, at) ) found = &ts;
+
+	  if(found) {
+	    ++ts.hits;
+	    return found;
+	  }
+	}
+	return nullptr;
+      }
+    };
+
+    /**
+     * state of the search through the cases in operator()
+     */
+    class Choice {
+    public:
+      TestAndScan *best;	/**< the case with the earliest match so far */
+      Rule *rule;		/**< the rule best leads to */
+      std::ptrdiff_t position;	/**< where best matched */
+      TestAndScan *in_match;	/**< the case whose result the Match currently holds */
+      bool otherwise;		/**< stopped at an Otherwise */
+
+      Choice() : best(nullptr), rule(nullptr), position(-1), in_match(nullptr), otherwise(false) {}
+    };
+
+    /**
+     * test each case against m's input, picking the match closest to the beginning (ties go to the first case).
+     *
+     * @return true if the search is over: a match at position 0, or an Otherwise was reached
+     */
+    static bool choose(match_vec_type &cases, Match &m, Choice &c, bool multiline) {
+      for(auto &ts : cases) {
+	if(ts.pattern == nullptr) { /* hit an otherwise */
+	  ++ts.hits;
+	  c.rule = ts.rule;
+	  c.otherwise = true;
+	  return true;
+	}
+
+	if(ts.factored) {
+	  /* with a newline in the input, ^ could match somewhere other than the start; fall back to the original cases */
+	  if(multiline) {
+	    if( choose(ts.factored->originals, m, c, multiline) ) return true;
+	    continue;
+	  }
+
+	  TestAndScan *leaf = ts.factored->find(ts.pattern, m, 0);
+	  c.in_match = leaf ? &ts : nullptr;
+	  if(leaf) {
+	    c.best = &ts;
+	    c.rule = leaf->rule;
+	    c.position = 0;
+	    return true;
+	  }
+	  continue;
+	}
+
+	bool found = ts.pattern->find(m);
+	c.in_match = found ? &ts : nullptr;
+	if(!found) continue;
+
+	std::ptrdiff_t pos = m.position();
+	if(pos == 0) { /* best case; take first matching rule */
+	  c.best = &ts;
+	  c.rule = ts.rule;
+	  c.position = 0;
+	  return true;
+	}
+
+	if(c.best == nullptr || pos < c.position) {
+	  c.best = &ts;
+	  c.rule = ts.rule;
+	  c.position = pos;
+	}
+      }
+      return false;
+    }
+
+    /**
+     * replace runs of cases which share a prefix with a single Factored case (recursively, so the result is a trie).
+     *
+     * @param cases the cases to factor
+     * @param implicit_anchor true if the cases are only ever tried at a fixed offset (they follow a prefix)
+     * @return the factored cases
+     */
+    static match_vec_type factor(const match_vec_type &cases, bool implicit_anchor) {
+      std::vector<std::string> sources;
+      for(auto &ts : cases) sources.push_back( ts.pattern ? ts.pattern->source() : std::string() );
+      return factor(cases, sources, implicit_anchor);
+    }
+
+    /* sources[k] is what's left of the pattern of cases[k] to match; a Pattern is only made for it if it ends up as a
+       case (so the intermediate suffixes of a deep trie aren't compiled) */
+    static match_vec_type factor(const match_vec_type &cases, const std::vector<std::string> &sources, bool implicit_anchor) {
+      std::vector<std::unique_ptr<RegexAtoms> > atoms;
+      for(std::size_t k = 0; k < cases.size(); ++k) {
+	const TestAndScan &ts = cases[k];
+	if(ts.pattern == nullptr || ts.factored || ts.pattern->icaseP())
+	  atoms.push_back( std::unique_ptr<RegexAtoms>() );
+	else {
+	  atoms.push_back( std::unique_ptr<RegexAtoms>(new RegexAtoms(sources[k], implicit_anchor)) );
+	  if( !atoms.back()->anchoredP() ) atoms.back().reset();
+	}
+      }
+
+      match_vec_type result;
+      std::size_t i = 0;
+      while(i < cases.size()) {
+	std::size_t j = i + 1, shared = 0;
+
+	if(atoms[i]) {
+	  std::size_t common = atoms[i]->size();
+	  for(; j < cases.size() && atoms[j]; ++j) {
+	    std::size_t n = atoms[i]->deterministic_prefix( std::min(common, atoms[i]->common(*atoms[j])) );
+	    if(n == 0) break;
+	    common = shared = n;
+	  }
+	}
+
+	if(j - i < 2 || shared == 0) {
+	  result.push_back(cases[i]);
+	  if(cases[i].pattern && cases[i].pattern->source() != sources[i])
+	    result.back().pattern = new Pattern(sources[i]);
+	  ++i;
+	  continue;
+	}
+
+	/* cases i..j share the first 'shared' atoms */
+	const RegexAtoms &a = *atoms[i];
+	std::size_t split = a.split_point(shared);
+
+	TestAndScan group;
+	group.pattern = new Pattern( a.source().substr(0, split) );
+	group.do_capture = cases[i].do_capture;
+	group.factored = std::make_shared<Factored>();
+
+	match_vec_type rest;
+	std::vector<std::string> rest_sources;
+	for(std::size_t k = i; k < j; ++k) {
+	  rest.push_back(cases[k]);
+	  rest_sources.push_back( sources[k].substr( atoms[k]->split_point(shared) ) );
+	  group.factored->originals.push_back(cases[k]);
+	}
+	group.factored->cases = factor(rest, rest_sources, true);
+
+	result.push_back(group);
+	i = j;
+      }
+      return result;
+    }
+
+    /* print a list of cases (used by print, recursive for factored cases) */
+    static void print_cases(PrintRecursiveRule &out, match_vec_type &cases) {
+      for(match_vec_type::iterator i = cases.begin();
+	  i != cases.end();
+	  ++i) {
+	out.indent_more();
+	out.newline();
+	out.print("scans: ");
+	if(i->pattern == nullptr)
+	  out.print("Otherwise ");
+	else
+	  out.print(i->pattern->str());
+	if(i->hits) {
+	  std::stringstream hits;
+	  hits << " (" << std::dec << i->hits << " hits)";
+	  out.print(hits.str());
+	}
+
+	if(i->factored) {
+	  out.print(" then");
+	  print_cases(out, i->factored->cases);
+	}
+	else {
+	  out.indent_more();
+	  out.newline();
+	  out.print(i->rule);
+	  out.indent_less();
+	}
+	out.indent_less();
+      }
+    }
+
+    /* fill in first/first_known (recursive for factored cases) */
+    static void find_first_bytes(match_vec_type &cases, bool implicit_anchor) {
+      for(auto &ts : cases) {
+	ts.first_known = false;
+	if(ts.pattern != nullptr && !ts.pattern->icaseP()) {
+	  RegexAtoms atoms(ts.pattern->source(), implicit_anchor);
+	  ts.first_known = atoms.anchoredP() && atoms.first_bytes(ts.first);
+	}
+	if(ts.factored) find_first_bytes(ts.factored->cases, true);
+      }
+    }
+
+    /* sort each run of cases with disjoint first bytes, most hits first (recursive for factored cases).  At most one case
+       of such a run can match at any position, so their order doesn't change which case is chosen. */
+    static void reorder(match_vec_type &cases) {
+      std::size_t i = 0;
+      while(i < cases.size()) {
+	RegexAtoms::CharSet seen;
+	std::size_t j = i;
+	while(j < cases.size() && cases[j].first_known && (seen & cases[j].first).none()) {
+	  seen |= cases[j].first;
+	  ++j;
+	}
+
+	if(j - i > 1)
+	  std::stable_sort(cases.begin() + i, cases.begin() + j
+			   , [](const TestAndScan &a, const TestAndScan &b) { return a.hits > b.hits; });
+	i = std::max(j, i + 1);
+      }
+
+      for(auto &ts : cases)
+	if(ts.factored) reorder(ts.factored->cases);
+    }
+
+    /* add the hits of each case to hits[case.index] (recursive for factored cases) */
+    static void collect_hits(match_vec_type &cases, std::vector<std::size_t> &hits) {
+      for(auto &ts : cases) {
+	if(ts.factored) {
+	  collect_hits(ts.factored->cases, hits);
+	  collect_hits(ts.factored->originals, hits);
+	}
+	else if(ts.index < hits.size()) hits[ts.index] += ts.hits;
+      }
+    }
+
+    /* set the hits of each case from hits[case.index], return the total (recursive for factored cases) */
+    static std::size_t assign_hits(match_vec_type &cases, const std::vector<std::size_t> &hits) {
+      std::size_t total = 0;
+      for(auto &ts : cases) {
+	if(ts.factored) {
+	  for(auto &o : ts.factored->originals) o.hits = 0;
+	  ts.hits = assign_hits(ts.factored->cases, hits);
+	}
+	else ts.hits = ts.index < hits.size() ? hits[ts.index] : 0;
+	total += ts.hits;
+      }
+      return total;
+    }
+
+    /* remember the cases as written, before they're factored or reordered */
+    void number_cases() {
+      if( !written_.empty() ) return;
+      for(std::size_t i = 0; i < match_rules_.size(); ++i) match_rules_[i].index = i;
+      written_ = match_rules_;
+    }
+
+    /* count a decision, and reorder if it's time */
+    void decided() {
+      if(reorder_interval_ && ++decisions_ >= reorder_interval_) {
+	decisions_ = 0;
+	reorder_cases();
+      }
+    }
+
+    /* apply fn to each case before factoring (recursive for factored cases) */
+    static void for_cases(match_vec_type &cases, const std::function<void (Pattern*, Rule*)> &fn) {
+      for(auto &ts : cases) {
+	if(ts.factored) for_cases(ts.factored->originals, fn);
+	else fn(ts.pattern, ts.rule);
+      }
+    }
+
+    /* apply fn to every pattern in cases, including factored prefixes and the originals (recursive) */
+    static void for_patterns(match_vec_type &cases, const std::function<void (Pattern*)> &fn) {
+      for(auto &ts : cases) {
+	if(ts.pattern) fn(ts.pattern);
+	if(ts.factored) {
+	  for_patterns(ts.factored->cases, fn);
+	  for_patterns(ts.factored->originals, fn);
+	}
+      }
+    }
+
+    bool factored_;		/**< some cases have been factored (see factor_prefixes) */
+    match_vec_type written_;	/**< the cases in the order they were written */
+    std::size_t reorder_interval_ /**< reorder cases after this many decisions (0 for never) */
+      , decisions_;		  /**< decisions since the last reordering */
     
     bool do_capture_
       , more_chars_;
@@ -59,6 +404,10 @@ namespace grammar {
       match_rules_ = orig.match_rules_;
       do_capture_ = orig.do_capture_;
       more_chars_ = orig.more_chars_;
+      factored_ = orig.factored_;
+      written_ = orig.written_;
+      reorder_interval_ = orig.reorder_interval_;
+      decisions_ = 0;
     }
 
   public:
@@ -71,6 +420,9 @@ namespace grammar {
       match_rules_.clear();
       do_capture_ = true;
       more_chars_ = false;
+      factored_ = false;
+      reorder_interval_ = 0;
+      decisions_ = 0;
     }
   
     /**
@@ -128,9 +480,15 @@ namespace grammar {
      * @param b branch to append
      */
     void append(Branch &b) {
-      match_vec_type::iterator i;
-      for(i = b.match_rules_.begin(); i != b.match_rules_.end(); ++i)
-	match_rules_.push_back( *i );
+      match_rules_.insert(match_rules_.end(), b.match_rules_.begin(), b.match_rules_.end());
+    }
+
+    /**
+     * a Branch beginning a case adds all its cases to branch
+     */
+    bool add_as_case(Branch *branch) {
+      branch->append(*this);
+      return true;
     }
   
     /**
@@ -150,11 +508,7 @@ namespace grammar {
 	return this;
       }
 
-      Match pos;
-      pos.set_input(raw);
-      best = pos;
-    
-      iterator best_rule = match_rules_.end();
+      best.set_input(raw);
 
 #ifdef DBG_GRAMMAR_BRANCH
       if( RunVerbose<Branch>::P() ) {
@@ -165,37 +519,38 @@ namespace grammar {
 
       /* test each rule against raw input for a match, and pick the match closest to
 	 the beginning of raw */
-      for(auto rule = match_rules_.begin(); rule != match_rules_.end(); ++rule) {
-	/* find a canidate match */
-	if( rule->pattern == nullptr ) { /* hit an otherwise */
-	  return rule->rule;
-
-	} else if( rule->pattern->find(pos) ) {
-	  if(pos.match.position() == 0) { /* best case; take first matching rule */
-	    best = pos;
-	    best_rule = rule;
-	    break;
-	  }
+      Choice choice;
+      choose(match_rules_, best, choice, factored_ && raw.find('\n') != string::npos);
 
-	  if( best.match.empty() || pos.match.position() < best.match.position() )  {	    
-	      best = pos;
-	      best_rule = rule;
-	    }
-	}}
+      if(choice.otherwise) {
+	decided();
+	return choice.rule;
+      }
 
       /* if I found a pattern match, scan the string and return the assosiated rule */
-      if(best_rule != match_rules_.end()) {
-	raw = best.suffix(); 	/* update raw to contain only the un-matched portion. */
+      if(choice.best != nullptr) {
+	/* a later case may have overwritten the best case's match; run it again */
+	if(choice.in_match != choice.best) choice.best->pattern->find(best);
+
+	/* the match runs to the end of a chunk of a stream: wait for the rest, which may change it */
+	if( best.cut_short(best.suffix_position(), raw.size()) ) {
+	  more_input = true;
+	  return this;
+	}
+
+	raw.erase(0, best.suffix_position()); /* update raw to contain only the un-matched portion. */
+	++choice.best->hits;
 	
 #ifdef DBG_GRAMMAR_BRANCH
 	if( RunVerbose<Branch>::P() ) {
-	  std::cout<<"found match to "<< best_rule->pattern->str() <<std::endl;
+	  std::cout<<"found match to "<< choice.best->pattern->str() <<std::endl;
 	  std::cout<<" and split string:"<< best[1] <<"|"<< raw <<std::endl;
-	  std::cout<<"    and rule type: "<< best_rule->rule->str() <<std::endl;
+	  std::cout<<"    and rule type: "<< choice.rule->str() <<std::endl;
 	}
 #endif
 	
-	return best_rule->rule;
+	decided();
+	return choice.rule;
       } else if( more_charsP() ) {
 	more_input = true;	/* signal the parser I want more chars */
 	return this;
@@ -210,7 +565,90 @@ namespace grammar {
 			  .append(" expected a delim before the newline.  Got: ")
 			  .append(raw) );
     }
-  
+
+    /**
+     * Left-factor the cases: a run of neighbouring cases whose (anchored) patterns begin with the same literal prefix,
+     * like ^\\s*</ and ^\\s*<!--, is replaced by one case which matches the prefix once and then tries the rest of each
+     * pattern, in order, from where the prefix ended.  This is applied recursively, so the cases end up in a prefix trie.
+     *
+     * Only prefixes which can match in exactly one way are factored, and neither captures nor the choice of case
+     * change: a Match produced through a factored case still reports the whole match as capture 0.
+     */
+    void factor_prefixes() {
+      number_cases();
+      match_vec_type factored = factor(match_rules_, false);
+      if(factored.size() != match_rules_.size()) {
+	match_rules_.swap(factored);
+	factored_ = true;
+      }
+      find_first_bytes(match_rules_, false);
+    }
+
+    /**
+     * Put the most frequently chosen cases first.  Only runs of neighbouring cases which are anchored and begin with
+     * disjoint sets of characters are sorted (by the hits counted so far), because for those the order can't change
+     * which case is chosen, only how many patterns are tried before it.
+     */
+    void reorder_cases() {
+      number_cases();
+      reorder(match_rules_);
+    }
+
+    /**
+     * reorder the cases (see reorder_cases) every interval decisions, so the Branch adapts to its input as it goes.
+     *
+     * @param interval number of decisions, 0 (the default) to never reorder
+     */
+    void set_reorder_interval(std::size_t interval) {
+      reorder_interval_ = interval;
+      decisions_ = 0;
+    }
+
+    /**
+     * the number of times each case has been chosen, in the order the cases were written.
+     */
+    std::vector<std::size_t> hits() {
+      number_cases();
+      std::vector<std::size_t> result(written_.size(), 0);
+      collect_hits(match_rules_, result);
+      return result;
+    }
+
+    /**
+     * replace the hit counts (for instance with a saved profile); call reorder_cases to act on them.
+     *
+     * @param counts hits of each case, in the order the cases were written
+     */
+    void set_hits(const std::vector<std::size_t> &counts) {
+      number_cases();
+      assign_hits(match_rules_, counts);
+    }
+
+    /**
+     * apply fn to the pattern and rule of each case, as written (so before factor_prefixes); the pattern of an Otherwise
+     * case is nullptr.
+     */
+    void for_each_case(const std::function<void (Pattern*, Rule*)> &fn) {
+      for_cases(written_.empty() ? match_rules_ : written_, fn);
+    }
+
+    /**
+     * apply fn to every pattern the Branch uses, including the ones factor_prefixes made.  A pattern may be visited more
+     * than once.
+     */
+    void for_each_pattern(const std::function<void (Pattern*)> &fn) {
+      for_patterns(match_rules_, fn);
+      for_patterns(written_, fn);
+    }
+
+    /**
+     * the rules of each case, and the default
+     */
+    void for_successors(const std::function<void (Rule*)> &fn) {
+      for_each_case( [&](Pattern*, Rule *r) { if(r) fn(r); } );
+      if( get_default() ) fn( get_default() );
+    }
+
     /**
      * simple string indicating the object's type
      */
@@ -227,24 +665,7 @@ namespace grammar {
       out.print(">");
     
       /* print the conditional branches */
-      for(match_vec_type::iterator i = match_rules_.begin();
-	  i != match_rules_.end();
-	  ++i) {
-	out.indent_more();
-	out.newline();
-	out.print("scans: ");
-	if(i->pattern == nullptr)
-	  out.print("Otherwise ");
-	else
-	  out.print(i->pattern->str());
-
-	out.indent_more();
-	out.newline();
-	out.print(i->rule);
-	out.indent_less();
-    
-	out.indent_less();
-      }
+      print_cases(out, match_rules_);
 
       /* print the default */
       if( get_default() ) {
@@ -283,6 +704,34 @@ namespace grammar {
      */
     match_vec_type& get_case_vector() { return match_rules_; }
   };
+
+  inline bool Otherwise::add_as_case(Branch *branch) {
+    branch->add_default( get_default() );
+    return true;
+  }
+
+  inline bool Until::add_as_case(Branch *branch) {
+    branch->add_branch( get_pattern(), get_default() );
+    return true;
+  }
+
+  inline bool Scan::add_as_case(Branch *branch) {
+    branch->add_branch( new Pattern( regex() ), get_default() );
+    return true;
+  }
+
+  /**
+   * apply Branch::factor_prefixes to every Branch reachable from root.
+   *
+   * @param root first rule of the grammar
+   */
+  inline void factor_branches(Rule *root) {
+    WalkRules walker;
+    walker.walk(root, [](Rule *r) {
+	Branch *b = dynamic_cast<Branch*>(r);
+	if(b) b->factor_prefixes();
+      });
+  }
 }
 
 #endif
@@ -0,0 +1,85 @@
+#ifndef GRAMMAR_BUDGET_HPP
+#define GRAMMAR_BUDGET_HPP
+/**
+ * @file grammar/Budget.hpp
+ *
+ * Limits on how much work one call of a Parser may do.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+
+namespace grammar {
+  /**
+   * how a budgeted call of Parser::operator() ended
+   */
+  enum class ParseStatus {
+    finished,			/**< the parser wants more input, or has run off the end of its grammar */
+    exhausted,			/**< a limit of the Budget was reached */
+    cancelled			/**< the Budget's cancellation flag was set */
+  };
+
+  /**
+   * Limits on one call of Parser::operator(): a number of rules, a number of input characters, a deadline, and a flag
+   * another thread can set to cancel.  The Parser stops between rules, so a call which runs out can be resumed by
+   * calling again with the rest of the input (the string passed in is left holding it).
+   *
+   * The limits are checked before each rule: the rule which crosses the byte limit may consume a whole line past it.
+   * The clock and the flag are only looked at every check_interval rules.
+   */
+  class Budget {
+  public:
+    typedef std::chrono::steady_clock clock;
+    static const std::size_t check_interval = 64; /**< rules between looking at the clock and cancellation flag */
+
+  private:
+    std::size_t _steps		/**< most rules to apply (0 for no limit) */
+      , _bytes;			/**< most input characters to consume (0 for no limit) */
+    clock::time_point _deadline;
+    const std::atomic<bool> *_cancel;
+  public:
+    /**
+     * no limits
+     */
+    Budget() : _steps(0), _bytes(0), _deadline(clock::time_point::max()), _cancel(nullptr) {}
+
+    /** stop after applying n rules */
+    Budget& steps(std::size_t n) { _steps = n; return *this; }
+
+    /** stop once n characters of input have been consumed */
+    Budget& bytes(std::size_t n) { _bytes = n; return *this; }
+
+    /** stop at time t */
+    Budget& deadline(clock::time_point t) { _deadline = t; return *this; }
+
+    /** stop once d has passed (from now) */
+    template<class Rep, class Period>
+    Budget& within(std::chrono::duration<Rep, Period> d) {
+      return deadline( clock::now() + std::chrono::duration_cast<clock::duration>(d) );
+    }
+
+    /** stop once flag is set; flag has to outlive the call */
+    Budget& cancel_on(const std::atomic<bool> &flag) { _cancel = &flag; return *this; }
+
+    /**
+     * may the parser apply another rule?
+     *
+     * @param steps rules applied so far in this call
+     * @param consumed characters of input consumed so far (negative if more were put back)
+     * @return finished to go on, otherwise the reason to stop
+     */
+    ParseStatus check(std::size_t steps, std::ptrdiff_t consumed) const {
+      if(_steps && steps >= _steps) return ParseStatus::exhausted;
+      if(_bytes && consumed >= static_cast<std::ptrdiff_t>(_bytes)) return ParseStatus::exhausted;
+
+      if(steps % check_interval == 0) {
+	if(_cancel && _cancel->load(std::memory_order_relaxed)) return ParseStatus::cancelled;
+	if(_deadline != clock::time_point::max() && clock::now() >= _deadline) return ParseStatus::exhausted;
+      }
+      return ParseStatus::finished;
+    }
+  };
+}
+
+#endif
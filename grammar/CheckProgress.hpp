@@ -0,0 +1,264 @@
+#ifndef GRAMMAR_CHECKPROGRESS_HPP
+#define GRAMMAR_CHECKPROGRESS_HPP
+/**
+ * @file grammar/CheckProgress.hpp
+ *
+ * Looks for loops in a grammar which can go around without consuming any input.  The Parser would spin on such a loop
+ * forever (the same input makes the same choices every time around), so Parser::sink refuses grammars which have one.
+ */
+
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "./Rule.hpp"
+#include "./Pattern.hpp"
+#include "./RegexAtoms.hpp"
+#include "./Until.hpp"
+#include "./Scan.hpp"
+#include "./Branch.hpp"
+#include "./PutBack.hpp"
+#include "./Label.hpp"
+#include "./GotoLabel.hpp"
+#include "./Stop.hpp"
+#include "./If.hpp"
+
+namespace grammar {
+  /**
+   * Builds the graph of transitions which may not consume input and finds its cycles.
+   *
+   * A scan (an Until or Scan, or a case of a Branch) consumes input unless its pattern can make an empty match at the
+   * start of its input, or the scanned characters are put back before the next scan.  Everything else (labels, gotos,
+   * reductions, Otherwise cases, the default of a Branch) doesn't consume.  If and Stop are treated as ways out: an If
+   * depends on state the actions may change, and a Stop waits for more input.
+   *
+   * Patterns are checked by running them on a set of short probe strings, so this is a heuristic; Parser also keeps a
+   * runtime count (see Parser::set_stall_limit).
+   */
+  class CheckProgress {
+  public:
+    typedef std::vector<std::string> Path; /**< names of the labels along a loop */
+  private:
+    class Edge {
+    public:
+      std::size_t to;		/**< index of the following rule */
+      bool consumes;		/**< taking this edge always consumes input */
+    };
+
+    std::vector<Rule*> _rules;	/**< every rule, in the order they were found */
+    std::unordered_map<Rule*, std::size_t> _index; /**< position of each rule in _rules */
+    std::vector<std::vector<Edge> > _edges; /**< edges leaving each rule, by index */
+
+    typedef std::unordered_map<std::string, bool> Verdicts;
+    Verdicts _stalls		/**< stallsP for the patterns of Branch cases, by pattern (generated grammars repeat them) */
+      , _stalls_empty		/**< stallsP for the patterns of Untils */
+      , _total;			/**< totalP */
+
+    /* look up or work out test(pattern, ...) */
+    template<class Test>
+    static bool remember(Verdicts &verdicts, Pattern *pattern, Test test) {
+      std::string key = pattern->source();
+      key.push_back( pattern->icaseP() ? 'i' : '-' );
+
+      Verdicts::iterator found = verdicts.find(key);
+      if(found != verdicts.end()) return found->second;
+      return verdicts[key] = test(pattern);
+    }
+
+    /* inputs the patterns are tried on; the parser is fed lines, so there's no newline */
+    static const std::vector<std::string>& probes() {
+      static std::vector<std::string> result;
+      if(result.empty())
+	for(char c = ' '; c <= '~'; ++c) result.push_back( std::string(1, c) );
+      return result;
+    }
+
+    /* true if pattern may match nothing at the start of its input; the empty input only reaches an Until (a Branch
+       waits for more input instead) */
+    static bool stallsP(Pattern *pattern, bool empty_input) {
+      /* a pattern which has to begin with some character can't make an empty match */
+      RegexAtoms::CharSet first;
+      if( !pattern->icaseP() && RegexAtoms(pattern->source(), true).first_bytes(first) )
+	return false;
+
+      Match m;
+      if(empty_input && pattern->find( m.set_input("") ) && m.position() == 0 && m.length() == 0)
+	return true;
+
+      for(auto &probe : probes())
+	if( pattern->find( m.set_input(probe) ) && m.position() == 0 && m.length() == 0 )
+	  return true;
+      return false;
+    }
+
+    /* true if pattern matches (somewhere in) any non-empty input, so the Branch default can't be reached */
+    static bool totalP(Pattern *pattern) {
+      /* nor can it match a probe it can't begin with */
+      RegexAtoms::CharSet first;
+      if( !pattern->icaseP() && RegexAtoms(pattern->source(), true).first_bytes(first) ) {
+	for(auto &probe : probes())
+	  if( !first[static_cast<unsigned char>(probe[0])] ) return false;
+      }
+
+      Match m;
+      for(auto &probe : probes())
+	if( !pattern->find( m.set_input(probe) ) ) return false;
+      return true;
+    }
+
+    /* true if the characters scanned before reaching r are put back before anything else is scanned */
+    static bool put_backP(Rule *r) {
+      std::set<Rule*> seen;
+      while(r && seen.insert(r).second) {
+	if( dynamic_cast<PutBack*>(r) ) return true;
+	if( dynamic_cast<Until*>(r) || dynamic_cast<Scan*>(r) || dynamic_cast<Branch*>(r) || dynamic_cast<If*>(r) || dynamic_cast<Stop*>(r) )
+	  return false;
+	r = r->get_default();
+      }
+      return false;
+    }
+
+    void add_edge(std::size_t from, Rule *to, bool consumes) {
+      if(to) _edges[from].push_back( Edge{_index[to], consumes} );
+    }
+
+    void add_edges(std::size_t i) {
+      Rule *r = _rules[i];
+      Until *until;
+      Scan *scan;
+      Branch *branch;
+
+      if( dynamic_cast<If*>(r) || dynamic_cast<Stop*>(r) )
+	return;
+
+      if( (until = dynamic_cast<Until*>(r)) ) {
+	bool stalls = remember(_stalls_empty, until->get_pattern(), [](Pattern *p) { return stallsP(p, true); });
+	add_edge(i, r->get_default(), !stalls && !put_backP( r->get_default() ));
+      }
+      else if( (scan = dynamic_cast<Scan*>(r)) )
+	add_edge(i, r->get_default(), !scan->emptyP() && !put_backP( r->get_default() ));
+      else if( (branch = dynamic_cast<Branch*>(r)) ) {
+	bool total = false;
+	branch->for_each_case([&](Pattern *pattern, Rule *rule) {
+	    if(pattern == nullptr) {
+	      total = true;
+	      add_edge(i, rule, false);
+	    }
+	    else {
+	      total = total || remember(_total, pattern, totalP);
+	      bool stalls = remember(_stalls, pattern, [](Pattern *p) { return stallsP(p, false); });
+	      add_edge(i, rule, !stalls && !put_backP(rule));
+	    }
+	  });
+
+	if(!total && !branch->more_charsP())
+	  add_edge(i, r->get_default(), false);
+      }
+      else
+	r->for_successors( [&](Rule *next) { add_edge(i, next, false); } );
+    }
+
+    /* the names of the labels along a loop */
+    static Path describe(const std::vector<Rule*> &loop) {
+      Path path;
+      for(auto r : loop) {
+	Label *label = nullptr;
+	GotoLabel *go;
+
+	if( (go = dynamic_cast<GotoLabel*>(r)) ) label = go->get_label();
+	else if( !dynamic_cast<Stop*>(r) ) label = dynamic_cast<Label*>(r);
+
+	if(label && label->get_name() != "post-branch"
+	   && (path.empty() || path.back() != label->get_name()))
+	  path.push_back( label->get_name() );
+      }
+
+      if(path.empty() && !loop.empty()) path.push_back( loop.front()->str() );
+      return path;
+    }
+  public:
+    /**
+     * build the graph of the grammar starting at start
+     *
+     * @param start first rule of the grammar
+     */
+    CheckProgress(Rule *start) {
+      WalkRules walker;
+      walker.walk(start, [&](Rule *r) {
+	  _index[r] = _rules.size();
+	  _rules.push_back(r);
+	});
+
+      _edges.resize( _rules.size() );
+      for(std::size_t i = 0; i < _rules.size(); ++i) add_edges(i);
+    }
+
+    /**
+     * find the loops which may not consume input.  Each loop is reported once, by the first rule on it which is reached.
+     *
+     * @return the label names along each loop
+     */
+    std::vector<Path> loops() {
+      enum { unvisited, open, done };
+      std::vector<int> state(_rules.size(), unvisited);
+      std::vector<Path> result;
+
+      for(std::size_t root = 0; root < _rules.size(); ++root) {
+	if(state[root] != unvisited) continue;
+
+	/* iterative depth first search over the non-consuming edges; stack holds the rules on the current path */
+	std::vector<std::pair<std::size_t, std::size_t> > stack;
+	stack.push_back( std::make_pair(root, 0) );
+	state[root] = open;
+
+	while(!stack.empty()) {
+	  std::size_t r = stack.back().first;
+	  std::vector<Edge> &edges = _edges[r];
+	  std::size_t &next = stack.back().second;
+
+	  while(next < edges.size() && edges[next].consumes) ++next;
+	  if(next == edges.size()) {
+	    state[r] = done;
+	    stack.pop_back();
+	    continue;
+	  }
+
+	  std::size_t to = edges[next++].to;
+	  if(state[to] == unvisited) {
+	    state[to] = open;
+	    stack.push_back( std::make_pair(to, 0) );
+	  }
+	  else if(state[to] == open) {
+	    /* found a loop: from to back around to r */
+	    std::vector<Rule*> loop;
+	    std::size_t i = stack.size();
+	    while(i > 0 && stack[i - 1].first != to) --i;
+	    for(--i; i < stack.size(); ++i) loop.push_back( _rules[stack[i].first] );
+	    result.push_back( describe(loop) );
+	  }
+	}
+      }
+      return result;
+    }
+
+    /**
+     * a message listing the loops, as Parser::sink reports them
+     *
+     * @param loops result of loops()
+     */
+    static std::string message(const std::vector<Path> &loops) {
+      std::string msg("Parser cannot sink grammar; it may loop without consuming input through: ");
+      for(std::size_t i = 0; i < loops.size(); ++i) {
+	if(i) msg.append("; ");
+	for(std::size_t j = 0; j < loops[i].size(); ++j) {
+	  if(j) msg.append(" -> ");
+	  msg.append(loops[i][j]);
+	}
+      }
+      return msg;
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef GRAMMAR_CHECKPOINT_HPP
+#define GRAMMAR_CHECKPOINT_HPP
+/**
+ * @file grammar/Checkpoint.hpp
+ *
+ * The encoding of checkpoints (see Parser::save_checkpoint): numbers and strings in a compact binary form, for the
+ * Parser and for the hooks which save the actions' state alongside it.
+ */
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+namespace grammar {
+  namespace checkpoint {
+    /**
+     * write n, seven bits to a byte, low bits first, the high bit of a byte set if more follow
+     */
+    inline void write(std::ostream &out, std::uint64_t n) {
+      while(n >= 0x80) {
+	out.put( char((n & 0x7f) | 0x80) );
+	n >>= 7;
+      }
+      out.put( char(n) );
+    }
+
+    /**
+     * write s: its length, then its characters
+     */
+    inline void write(std::ostream &out, const std::string &s) {
+      write(out, std::uint64_t( s.size() ));
+      out.write(s.data(), s.size());
+    }
+
+    /**
+     * read a number written by write
+     *
+     * @throw std::runtime_error if the checkpoint ends first
+     */
+    inline std::uint64_t read_number(std::istream &in) {
+      std::uint64_t n = 0;
+      for(unsigned shift = 0; shift < 64; shift += 7) {
+	int byte = in.get();
+	if(byte == std::istream::traits_type::eof()) throw std::runtime_error("checkpoint is cut short");
+	n |= std::uint64_t(byte & 0x7f) << shift;
+	if( !(byte & 0x80) ) return n;
+      }
+      throw std::runtime_error("checkpoint has a malformed number");
+    }
+
+    /**
+     * read a string written by write
+     *
+     * @throw std::runtime_error if the checkpoint ends first
+     */
+    inline std::string read_string(std::istream &in) {
+      std::uint64_t size = read_number(in);
+      std::string s;
+      /* grow as characters arrive, rather than trusting a size which may be garbage */
+      char buffer[4096];
+      while(size) {
+	std::size_t n = size < sizeof(buffer) ? std::size_t(size) : sizeof(buffer);
+	if( !in.read(buffer, n) ) throw std::runtime_error("checkpoint is cut short");
+	s.append(buffer, n);
+	size -= n;
+      }
+      return s;
+    }
+  }
+}
+
+#endif
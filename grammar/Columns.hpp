@@ -0,0 +1,102 @@
+#ifndef GRAMMAR_COLUMNS_HPP
+#define GRAMMAR_COLUMNS_HPP
+/**
+ * @file grammar/Columns.hpp
+ *
+ * Columnar output from a Parser: a record per reduction appended to flat arrays, for consumers which process tokens in
+ * batches, instead of a callback per reduction.
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "./Parser.hpp"
+
+namespace grammar {
+  /**
+   * Records of the reductions a Parser made, one per reduction, held column by column: record i is (offset[i],
+   * length[i], capture[i], rule[i]).  Offsets count from the beginning of the stream, so the text of a record has to be
+   * kept by the caller if it's wanted (nothing is copied here).
+   *
+   * Offsets assume each reduction comes straight after its scan, as it does in a grammar without put backs between
+   * them.
+   */
+  class TokenColumns {
+  public:
+    std::vector<std::uint64_t> offset; /**< stream offset of the capture (of the whole match if it didn't take part) */
+    std::vector<std::uint32_t> length; /**< length of the capture (0 if it didn't take part) */
+    std::vector<std::uint16_t> capture; /**< index of the capture the reduction takes (see Reduce::capture) */
+    std::vector<std::uint32_t> rule;	/**< id of the reduction (see Parser::rule_id) */
+    std::uint64_t position;		/**< stream offset of the next chunk pushed */
+
+    TokenColumns() : position(0) {}
+
+    /** @return the number of records */
+    std::size_t size() const { return rule.size(); }
+
+    /** room for n records */
+    void reserve(std::size_t n) {
+      offset.reserve(n);
+      length.reserve(n);
+      capture.reserve(n);
+      rule.reserve(n);
+    }
+
+    /** drop the records (once they've been processed), keeping the stream position */
+    void clear() {
+      offset.clear();
+      length.clear();
+      capture.clear();
+      rule.clear();
+    }
+
+    /**
+     * append a record of the capture index of match
+     *
+     * @param match_at stream offset of the beginning of match.input()
+     */
+    void append(const Match &match, int index, std::uint64_t match_at, std::uint32_t id) {
+      if( match.matched(index) ) {
+	offset.push_back( match_at + match.position(index) );
+	length.push_back( match.length(index) );
+      }
+      else {
+	offset.push_back( match_at + (match.matched(0) ? match.position(0) : 0) );
+	length.push_back(0);
+      }
+      capture.push_back(index);
+      rule.push_back(id);
+    }
+  };
+
+  inline void Parser::push(std::string &buffer, TokenColumns &out, bool more) {
+    _scanned.set_open_end(more);
+    bool more_input_needed = false;
+    std::size_t start = buffer.size(), left = start, stalled = 0;
+    Rule *applied = nullptr;
+
+    while(_rule && !more_input_needed) {
+      Reduce *reduce = dynamic_cast<Reduce*>(_rule);
+      if(!reduce) {
+	applied = step(_scanned, buffer, more_input_needed, left, stalled);
+	continue;
+      }
+
+      /* the input starts where the scan's match ended */
+      std::int64_t input_at = out.position + std::int64_t(start) - std::int64_t(buffer.size())
+	, match_end = _scanned.matched(0) ? _scanned.position(0) + _scanned.length(0) : 0;
+      out.append(_scanned, reduce->capture(), input_at - match_end, rule_id(reduce));
+
+      applied = _rule;
+      _rule = reduce->get_default();
+      stepped(buffer, left, stalled);
+    }
+
+    _holding = more_input_needed && _rule == applied;
+    out.position += start - (_holding ? buffer.size() : 0);
+    if(!_holding) buffer.clear();
+  }
+}
+
+#endif
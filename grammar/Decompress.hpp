@@ -0,0 +1,205 @@
+#ifndef GRAMMAR_DECOMPRESS_HPP
+#define GRAMMAR_DECOMPRESS_HPP
+/**
+ * @file grammar/Decompress.hpp
+ *
+ * Reads compressed input (gzip or zlib, and zstd where it's built in) for InputPipeline, decompressing on the
+ * pipeline's reader thread straight into its buffers, rather than through a zcat and a pipe.
+ *
+ * zlib is always there (link with -lz).  zstd needs GRAMMAR_HAVE_ZSTD defined, and -lzstd.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <istream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#ifdef GRAMMAR_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace grammar {
+  enum class Compression { none, gzip, zlib, zstd };
+
+  /**
+   * @return the compression magic begins with, or Compression::none; size may be as little as one character, where a
+   * stream can't be read ahead any further
+   */
+  inline Compression compression_of(const char *magic, std::size_t size) {
+    const unsigned char *m = reinterpret_cast<const unsigned char*>(magic);
+    if(size >= 1 && m[0] == 0x1f && (size < 2 || m[1] == 0x8b)) return Compression::gzip;
+    if(size >= 1 && m[0] == 0x28 && (size < 4 || (m[1] == 0xb5 && m[2] == 0x2f && m[3] == 0xfd)))
+      return Compression::zstd;
+    /* a zlib header: deflate, and a check on the first two bytes (so not "x<" or the like) */
+    if(size >= 2 && (m[0] & 0x0f) == 8 && (m[0] >> 4) <= 7 && (m[0] << 8 | m[1]) % 31 == 0) return Compression::zlib;
+    return Compression::none;
+  }
+
+  /**
+   * look at the start of in for a compressed format's magic number, leaving in where it was.  Only the first character
+   * is looked at if in can't seek (std::cin on a pipe, say).
+   */
+  inline Compression detect_compression(std::istream &in) {
+    std::streampos at = in.tellg();
+    if(at == std::streampos(-1)) {
+      char c = char( in.peek() );
+      in.clear();
+      return compression_of(&c, in.good() ? 1 : 0);
+    }
+    char magic[4];
+    in.read(magic, sizeof(magic));
+    std::size_t size = in.gcount();
+    in.clear();
+    in.seekg(at);
+    return compression_of(magic, size);
+  }
+
+  /**
+   * Decompresses in, which is read a buffer at a time; as an InputPipeline::Source (wrapped in a lambda: it can't be
+   * copied) it runs on the pipeline's reader thread.  Concatenated gzip members or zstd frames are read one after
+   * another, as zcat would.  Compression::none copies in as it is.
+   *
+   * Calls throw std::runtime_error if the input is corrupt or cut short.
+   */
+  class DecompressSource {
+    std::istream &_in;
+    Compression _format;
+    std::vector<char> _buffer;	/**< compressed input, read ahead */
+    bool _between;		/**< at the end of a member or frame, so the input may end here */
+    bool _ended;
+    z_stream _zlib;
+#ifdef GRAMMAR_HAVE_ZSTD
+    ZSTD_DStream *_zstd;
+    ZSTD_inBuffer _zstd_in;
+#endif
+
+    /* read more of the input into _buffer; returns the number read, 0 at the end */
+    std::size_t fill() {
+      _in.read(_buffer.data(), _buffer.size());
+      return _in.gcount();
+    }
+
+    void cut_short() {
+      throw std::runtime_error("DecompressSource: compressed input is cut short");
+    }
+
+    std::size_t unzip(char *data, std::size_t size) {
+      /* avail_out is only a uInt */
+      size = std::min<std::size_t>(size, 1u << 30);
+      _zlib.next_out = reinterpret_cast<Bytef*>(data);
+      _zlib.avail_out = size;
+      for(;;) {
+	if(!_zlib.avail_in) {
+	  _zlib.next_in = reinterpret_cast<Bytef*>( _buffer.data() );
+	  _zlib.avail_in = fill();
+	  if(!_zlib.avail_in) {
+	    if(!_between) cut_short();
+	    _ended = true;
+	    return size - _zlib.avail_out;
+	  }
+	}
+	int result = inflate(&_zlib, Z_NO_FLUSH);
+	if(result == Z_STREAM_END) {
+	  /* another member may follow */
+	  inflateReset(&_zlib);
+	  _between = true;
+	}
+	else if(result == Z_OK || result == Z_BUF_ERROR)
+	  _between = false;
+	else
+	  throw std::runtime_error( std::string("DecompressSource: ") + (_zlib.msg ? _zlib.msg : "corrupt input") );
+	if(_zlib.avail_out < size) return size - _zlib.avail_out;
+      }
+    }
+
+#ifdef GRAMMAR_HAVE_ZSTD
+    std::size_t unzstd(char *data, std::size_t size) {
+      ZSTD_outBuffer out = { data, size, 0 };
+      for(;;) {
+	if(_zstd_in.pos == _zstd_in.size) {
+	  _zstd_in.pos = 0;
+	  _zstd_in.size = fill();
+	  if(!_zstd_in.size) {
+	    if(!_between) cut_short();
+	    _ended = true;
+	    return out.pos;
+	  }
+	}
+	std::size_t result = ZSTD_decompressStream(_zstd, &out, &_zstd_in);
+	if( ZSTD_isError(result) ) throw std::runtime_error( std::string("DecompressSource: ") + ZSTD_getErrorName(result) );
+	_between = result == 0;
+	if(out.pos) return out.pos;
+      }
+    }
+#endif
+  public:
+    /**
+     * decompress in (see detect_compression), from where it is; in has to outlive the source
+     *
+     * @param buffer_size compressed characters read at a time
+     * @throw std::runtime_error if format is zstd and it isn't built in
+     */
+    DecompressSource(std::istream &in, Compression format, std::size_t buffer_size = 1 << 16)
+      : _in(in), _format(format), _buffer(buffer_size ? buffer_size : 1), _between(true), _ended(false) {
+      std::memset(&_zlib, 0, sizeof(_zlib));
+      switch(format) {
+      case Compression::gzip:
+      case Compression::zlib:
+	/* 32 more bits of window: tell gzip from zlib by the header */
+	if( inflateInit2(&_zlib, 15 + 32) != Z_OK ) throw std::runtime_error("DecompressSource: can't start zlib");
+	break;
+      case Compression::zstd:
+#ifdef GRAMMAR_HAVE_ZSTD
+	_zstd = ZSTD_createDStream();
+	if(!_zstd) throw std::runtime_error("DecompressSource: can't start zstd");
+	ZSTD_initDStream(_zstd);
+	_zstd_in.src = _buffer.data();
+	_zstd_in.size = _zstd_in.pos = 0;
+	break;
+#else
+	throw std::runtime_error("DecompressSource: built without zstd (see GRAMMAR_HAVE_ZSTD)");
+#endif
+      case Compression::none:
+	break;
+      }
+    }
+
+    DecompressSource(const DecompressSource&) = delete;
+
+    ~DecompressSource() {
+      if(_format == Compression::gzip || _format == Compression::zlib) inflateEnd(&_zlib);
+#ifdef GRAMMAR_HAVE_ZSTD
+      if(_format == Compression::zstd) ZSTD_freeDStream(_zstd);
+#endif
+    }
+
+    Compression format() const { return _format; }
+
+    /**
+     * decompress up to size characters into data
+     *
+     * @return the number decompressed; 0 only at the end of the input
+     */
+    std::size_t operator()(char *data, std::size_t size) {
+      if(_ended || !size) return 0;
+      switch(_format) {
+      case Compression::gzip:
+      case Compression::zlib:
+	return unzip(data, size);
+#ifdef GRAMMAR_HAVE_ZSTD
+      case Compression::zstd:
+	return unzstd(data, size);
+#endif
+      default:
+	_in.read(data, size);
+	return _in.gcount();
+      }
+    }
+  };
+}
+
+#endif
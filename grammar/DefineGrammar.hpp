@@ -86,11 +86,9 @@ namespace grammar {
     }
 
   public:
-    DefineGrammar() { _grammar = new GrammarTree(); }
+    DefineGrammar() { _grammar = GrammarTree::make(); }
 
-    ~DefineGrammar() {
-      if(_grammar) delete _grammar;
-    }
+    ~DefineGrammar() { GrammarTree::recycle(_grammar); }
 
     /* Stealing constructor */
     DefineGrammar(DefineGrammar &&orig) : _grammar( orig.release_grammar() ) {}
@@ -101,8 +99,7 @@ namespace grammar {
     DefineGrammar& operator=(DefineGrammar&& src) {
       /* strip casting */
       if((void*)&src != (void*)this) {
-	if(_grammar)
-	  delete _grammar;
+	GrammarTree::recycle(_grammar);
 	/* owns_grammar_ = src.owns_grammar_; */
 	_grammar = src.release_grammar();
       }
@@ -123,21 +120,69 @@ namespace grammar {
       return std::move(*this);
     }
     
+    /**
+     * find a literal string; like re() with the string quoted, without the regex engine.
+     *
+     * @param literal the string to find
+     */
+    DefineGrammar&& lit(const std::string &literal) {
+      _grammar->scan( new Literal(literal) );
+      return std::move(*this);
+    }
+
+    /**
+     * scan everything before the next c, leaving c at the start of the input; like re("^[^c]*(?=c)").
+     */
+    DefineGrammar&& skip_to(char c) {
+      _grammar->scan( new SkipTo(c) );
+      return std::move(*this);
+    }
+
+    /**
+     * find the first character in cls; like re("[...]").
+     *
+     * @param cls the characters (as a string, or a predicate like ::isdigit)
+     */
+    DefineGrammar&& one_of(const CharClass &cls) {
+      _grammar->scan( new OneOf(cls) );
+      return std::move(*this);
+    }
+
+    /**
+     * scan the (possibly empty) run of characters in cls at the start of the input; like re("^[...]*").
+     *
+     * @param cls the characters (as a string, or a predicate like ::isdigit)
+     */
+    DefineGrammar&& take_while(const CharClass &cls) {
+      _grammar->scan( new TakeWhile(cls) );
+      return std::move(*this);
+    }
+
     /**
      * Call hook on the last string accumulator, then clear the string accumulator.
      * 
      * @param hook the hook to call
      * @param index index of the match to pass into hook (like Match, 0 is whole match, 1 is first capture etc)
+     * @tparam F type of the hook, called as hook(const std::string&)
      * @return: this
      */
-    DefineGrammar&& on_string(std::function<void(const std::string&)> hook, int index = 0) {
-      return reduce( [=](Match &scanned) mutable {
-	  hook( scanned[index] );
-	});
+    template<class F>
+    DefineGrammar&& on_string(F hook, int index = 0) {
+      _grammar->reduce( new ReduceString<F>(hook, index) );
+      return std::move(*this);
     }
 
-    DefineGrammar&& on_match(std::function<void(Match&)> hook) {
-      return reduce( hook );
+    /**
+     * Call hook with the Match from the last scan.
+     *
+     * @tparam F type of the hook, called as hook(Match&)
+     * @param hook the hook to call
+     * @return: this
+     */
+    template<class F>
+    DefineGrammar&& on_match(F hook) {
+      _grammar->reduce( new ReduceWith<F>(hook) );
+      return std::move(*this);
     }
 
     /**
@@ -152,12 +197,12 @@ namespace grammar {
      */
     template<class F>
     DefineGrammar&& thunk( F hook ) {
-      /* wrap the hook with a string-taking closure.  I'm ignoring 'ignore', so it will not be modified through over this call. */
-      return reduce( [=](Match& ignored) mutable { hook(); });
+      _grammar->reduce( new ReduceThunk<F>(hook) );
+      return std::move(*this);
     }
 
     DefineGrammar&& ignore() {
-      return reduce( [=](Match& ignored) { });
+      return thunk( [](){} );
     }
     
     //! when this branch is reached, put the scanned string back into input
@@ -183,6 +228,17 @@ namespace grammar {
       push_cases( forward<T&&>(lst)... ); /* the arguments must be forwarded to preserve rvalue references */
       return std::move(*this);
     }
+
+    /**
+     * add one more case to the most recent branch.  For grammars generated at run time, where the cases can't all be
+     * passed to branch(...) at once.
+     *
+     * @param c the case; like the arguments of branch it must begin with a scanner
+     */
+    DefineGrammar&& add_case(DefineGrammar &&c) {
+      _grammar->push_case( c.release_grammar() );
+      return std::move(*this);
+    }
     
     //syntax for labeling and going to labels
     DefineGrammar&& go(const std::string& label) {
@@ -197,8 +253,8 @@ namespace grammar {
     
     //! tells the grammar to print an error if no matches found
     DefineGrammar&& error(const std::string& msg) {
-      std::string &capture = const_cast<std::string&>(msg);
-      return reduce( [=](Match &context) mutable { throw SyntaxError( capture.append(context[0]) ); } );
+      _grammar->reduce( new RaiseSyntaxError(msg) );
+      return std::move(*this);
     }
     
     DefineGrammar&& append(DefineGrammar &input) {
@@ -222,10 +278,11 @@ namespace grammar {
     void print() { _grammar->print(std::cout); }
 
     //! follow a branch if a std::function thunk evaluates to true.
-    DefineGrammar&& _if( std::function<bool ()> test, DefineGrammar &&consiquent) {
+    DefineGrammar&& _if( Action<bool ()> test, DefineGrammar &&consiquent) {
       _grammar->append_free_list(consiquent._grammar);
       _grammar->merge_tables(consiquent._grammar);
-      _grammar->grammar.push_back( If(test, consiquent.release_grammar()->begin()) );
+      _grammar->grammar.push_back( If(test, consiquent._grammar->begin()) );
+      GrammarTree::recycle( consiquent.release_grammar() );
     
       return std::move(*this);
     }
@@ -21,7 +21,7 @@ namespace grammar {
     /**
      * construct a GotoLabel with a given Label
      */
-    GotoLabel(Label *l = nullptr) {
+    GotoLabel(Label *l = nullptr) : _default(nullptr) {
       label_ = l;
     }
 
@@ -34,6 +34,13 @@ namespace grammar {
       label_ = l;
     }
 
+    /**
+     * label_ getter
+     *
+     * @return the Label I go to (NULL if unresolved)
+     */
+    Label* get_label() { return label_; }
+
     /**
      * ignores scanned string, returns the label->get_destination() value
      *
@@ -0,0 +1,196 @@
+#ifndef GRAMMAR_GRAMMARSET_HPP
+#define GRAMMAR_GRAMMARSET_HPP
+/**
+ * @file grammar/GrammarSet.hpp
+ *
+ * Routes input to one of many grammars, chosen by how the input begins.
+ */
+
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "./Parser.hpp"
+
+namespace grammar {
+  /**
+   * Holds many sunk grammars and feeds each input to the one it belongs to.
+   *
+   * The first scan of every grammar (an Until or Scan, or the cases of a Branch, reached through any leading labels)
+   * becomes a case of one selector Branch, whose cases are factored into a prefix trie like any other Branch's.
+   * Choosing a grammar is a single pass of the selector, and the chosen grammar carries on from just after the scan
+   * which selected it, with the scan's captures, so the leading token is only read once.
+   *
+   * Choices follow Branch: the earliest match wins, ties go to the grammar added first, and the Otherwise cases at the
+   * start of the grammars are tried after every pattern.  A grammar stays selected until it runs off its end, or until
+   * reset().
+   */
+  class GrammarSet {
+    /* a case of the selector: carry on with grammar at next */
+    class Selected : public SimpleGetSetDefault {
+    public:
+      std::size_t grammar;	/**< index of the grammar chosen */
+      Rule *next;		/**< rule of that grammar which follows the selecting scan */
+
+      Selected(std::size_t g, Rule *n) : grammar(g), next(n) { _default = nullptr; }
+      std::string str() { return std::string("<select grammar>"); }
+      Rule* operator()(Match &, std::string &, bool &) { return nullptr; } /* never applied; see GrammarSet::select */
+    };
+
+    static const std::size_t no_grammar = std::size_t(-1);
+
+    std::vector<std::unique_ptr<Parser> > _parsers;
+    std::vector<std::string> _names;
+    std::vector<std::unique_ptr<Selected> > _selected; /**< rules of the selector's cases */
+    std::vector<std::unique_ptr<Pattern> > _patterns;  /**< patterns standing in for grammars which begin with a Scan */
+    std::unique_ptr<Branch> _selector;		    /**< built on first use, after the grammars are all added */
+    Selected _no_match;				    /**< default of the selector */
+    Match _scanned;		/**< scanned characters, shared by the grammars since only one runs at a time */
+    std::size_t _current;	/**< grammar being run, or no_grammar */
+
+    /* the first scanning rule of a grammar, past any labels */
+    static Rule* entry(Rule *r) {
+      std::set<Rule*> seen;
+      while( r && seen.insert(r).second && (dynamic_cast<Label*>(r) || dynamic_cast<GotoLabel*>(r)) )
+	r = r->get_default();
+      return r;
+    }
+
+    Selected* selected(std::size_t grammar, Rule *next) {
+      _selected.push_back( std::unique_ptr<Selected>( new Selected(grammar, next) ) );
+      return _selected.back().get();
+    }
+
+    void build_selector() {
+      std::vector<std::pair<std::size_t, Rule*> > fallbacks; /* Otherwise cases, tried after all the patterns */
+
+      _selector.reset(new Branch);
+      for(std::size_t g = 0; g < _parsers.size(); ++g) {
+	Rule *start = entry( _parsers[g]->_root->begin() );
+	Until *until;
+	Scan *scan;
+	Branch *branch;
+
+	if( (until = dynamic_cast<Until*>(start)) )
+	  _selector->add_branch( until->get_pattern(), selected(g, until->get_default()) );
+	else if( (scan = dynamic_cast<Scan*>(start)) ) {
+	  _patterns.push_back( std::unique_ptr<Pattern>( new Pattern( scan->regex() ) ) );
+	  _selector->add_branch( _patterns.back().get(), selected(g, scan->get_default()) );
+	}
+	else if( (branch = dynamic_cast<Branch*>(start)) )
+	  branch->for_each_case([&](Pattern *pattern, Rule *rule) {
+	      if(pattern) _selector->add_branch( pattern, selected(g, rule) );
+	      else fallbacks.push_back( std::make_pair(g, rule) );
+	    });
+	else
+	  throw std::runtime_error( std::string("GrammarSet: grammar ").append(_names[g])
+				    .append(" doesn't begin with a scan, so input can't be routed to it.") );
+      }
+
+      for(auto &f : fallbacks) _selector->add_default( selected(f.first, f.second) );
+      _selector->set_default(&_no_match);
+      _selector->factor_prefixes();
+    }
+
+    /* choose the grammar for input; true if one was chosen, false if the selector wants more input */
+    bool select(std::string &input) {
+      if(!_selector) build_selector();
+
+      bool more_input = false;
+      Selected *s = static_cast<Selected*>( (*_selector)(_scanned, input, more_input) );
+      if(more_input) return false;
+
+      if(s == &_no_match)
+	throw SyntaxError( std::string("GrammarSet: no grammar accepts: ").append(input) );
+
+      _current = s->grammar;
+      _parsers[_current]->_rule = s->next;
+      return true;
+    }
+  public:
+    GrammarSet() : _no_match(no_grammar, nullptr), _current(no_grammar) {}
+    GrammarSet(const GrammarSet&) = delete;
+
+    /**
+     * sink a grammar into the set.  Grammars can't be added once the set has parsed something.
+     *
+     * @param name reported in errors and by selected_name
+     * @param def grammar to take
+     * @return index of the grammar (see selected)
+     * @throw std::runtime_error as Parser::sink does, or if the set is already in use
+     */
+    template<class Grammar>
+    std::size_t add(const std::string &name, Grammar &&def) {
+      if(_selector)
+	throw std::runtime_error("GrammarSet: can't add a grammar after parsing has begun.");
+
+      std::unique_ptr<Parser> parse(new Parser);
+      parse->sink( std::forward<Grammar>(def) );
+      _parsers.push_back( std::move(parse) );
+      _names.push_back(name);
+      return _parsers.size() - 1;
+    }
+
+    /**
+     * parse input with the grammar it selects (or the one already selected).  When the selected grammar runs off its
+     * end, the rest of the input selects again.
+     *
+     * @param input the string to parse
+     * @throw SyntaxError if no grammar accepts the input
+     */
+    void operator()(std::string &input) {
+      while(true) {
+	if(_current == no_grammar && !select(input)) return;
+
+	Parser &parse = *_parsers[_current];
+	parse.run(_scanned, input);
+	if( !parse.is_leaf() || input.empty() ) return;
+	_current = no_grammar;
+      }
+    }
+
+    /**
+     * alternate form of operator(), parses a copy of input
+     */
+    void operator()(const std::string &input) {
+      std::string copy = input;
+      (*this)(copy);
+    }
+
+    /**
+     * forget the selected grammar; the next input chooses again.
+     */
+    void reset() {
+      _current = no_grammar;
+      for(auto &p : _parsers) p->reset();
+    }
+
+    /**
+     * @return index of the selected grammar, or -1 if none is
+     */
+    std::size_t selected() const { return _current; }
+
+    /**
+     * @return name of the selected grammar, or "" if none is
+     */
+    std::string selected_name() const { return _current == no_grammar ? std::string() : _names[_current]; }
+
+    /**
+     * @return the number of grammars
+     */
+    std::size_t size() const { return _parsers.size(); }
+
+    /**
+     * print the selector
+     */
+    void print(std::ostream &out) {
+      if(!_selector) build_selector();
+      PrintRecursiveRule do_print(out);
+      do_print.print( _selector.get() );
+    }
+  };
+}
+
+#endif
@@ -6,7 +6,7 @@
  * Created on Oct 09, 2012
  */
 
-#include <map>
+#include <unordered_map>
 #include <vector>
 #include <string>
 #include <memory>
@@ -17,6 +17,7 @@
 #include "./Pattern.hpp"
 #include "./Reduce.hpp"
 #include "./Until.hpp"
+#include "./Scan.hpp"
 
 
 namespace grammar {
@@ -36,13 +37,27 @@ namespace grammar {
   private:
     Branch *active_branch_;	/**< active_branch data */
 
-    typedef std::map<std::string, Label*> SymbolTable;
+    typedef std::unordered_map<std::string, Label*> SymbolTable;
     SymbolTable environment_;           /**< explicit labels which I have definitions for. */
     
     typedef std::vector<GotoLabel*> PatchList;
-    typedef std::map<std::string, PatchList > UnresolvedSymbolTable;
+    typedef std::unordered_map<std::string, PatchList > UnresolvedSymbolTable;
     UnresolvedSymbolTable _unresolved; 	/**< labels which need, but haven't seen, definitions. */
 
+    static const std::size_t pool_size = 64; /**< most recycled trees kept for reuse */
+
+    /* recycled trees, per thread */
+    class Pool {
+    public:
+      std::vector<GrammarTree*> trees;
+      ~Pool() { for(auto t : trees) delete t; }
+    };
+
+    static std::vector<GrammarTree*>& pool() {
+      static thread_local Pool p;
+      return p.trees;
+    }
+
 
     //! retrieve the tree's current active branch
     Branch *active_branch() { return active_branch_; }
@@ -58,43 +73,91 @@ namespace grammar {
       _unresolved[name].push_back(pending);
     }
     
+    /**
+     * point the gotos waiting in reslv at their labels in env, and drop them from reslv.  Walks whichever table is smaller,
+     * so merging a small tree into a big one costs in proportion to the small one.
+     */
     void resolve(UnresolvedSymbolTable &reslv, SymbolTable &env) {
-      SymbolTable::iterator found; 		/* hold the result of searches */
-      UnresolvedSymbolTable::iterator temp;	/* used to un-chain intermediate */
+      if(reslv.empty() || env.empty()) return; 	/* nothing to be done. */
 
-      if(reslv.empty()) return; 	/* nothing to be done. */
-    
-      /* iterate through the reslv table to find pending resolutions */
-      UnresolvedSymbolTable::iterator resolving = reslv.begin();
-      while( resolving != reslv.end()) {
-	/* Is three now a defintion for the unresolved symbol?  */
-	if( (found = env.find( resolving->first ))
-	    != env.end() )
-	  {
-	    /* if there is, set the destination for every element in the unresolved list */
+      if(reslv.size() <= env.size()) {
+	/* iterate through the reslv table to find pending resolutions */
+	UnresolvedSymbolTable::iterator resolving = reslv.begin();
+	while( resolving != reslv.end()) {
+	  SymbolTable::iterator found = env.find( resolving->first );
+
+	  /* if there's a definition, set the destination for every element in the unresolved list and erase it */
+	  if(found != env.end()) {
 	    for(auto patching : resolving->second)
 	      patching->set_label( found->second );
-	
-	    temp = resolving;
-	    ++resolving;
-	    /* as the symbol is now resolved.  I can erase it. */
-	    reslv.erase(temp);
+	    resolving = reslv.erase(resolving);
 	  }
-      
-	/* if I didn't resolve the symbol, I still need to move onto the next. */
-	else ++resolving;
-      }}
+	  else ++resolving;
+	}
+      }
+      else {
+	/* look up each definition instead */
+	for(auto &defined : env) {
+	  UnresolvedSymbolTable::iterator resolving = reslv.find(defined.first);
+	  if(resolving == reslv.end()) continue;
+
+	  for(auto patching : resolving->second)
+	    patching->set_label( defined.second );
+	  reslv.erase(resolving);
+	}
+      }
+    }
+
+    /**
+     * empty the tree for reuse (the rules it holds aren't freed).
+     */
+    void clear() {
+      grammar.release();
+      active_branch_ = nullptr;
+      environment_.clear();
+      _unresolved.clear();
+    }
   public:
      /**
      * constructs an empty tree with default values
      * @see GrammarChain#GrammarChain
      */
-    GrammarTree() = default;
+    GrammarTree() : active_branch_(nullptr) {}
 
     /**
      * destructs grammar and frees any data structures that haven't been passed out with release
      */
     ~GrammarTree() = default;
+
+    /**
+     * an empty tree, recycled if one is available.  DefineGrammar makes a tree for every temporary (each re(...),
+     * label(...) and so on), so reusing them saves most of the allocation when building large grammars.
+     *
+     * @return the tree, which should be given back with recycle
+     */
+    static GrammarTree* make() {
+      std::vector<GrammarTree*> &free = pool();
+      if(free.empty()) return new GrammarTree();
+
+      GrammarTree *tree = free.back();
+      free.pop_back();
+      return tree;
+    }
+
+    /**
+     * give back a tree from make (or new).  The tree is emptied; the rules it still holds are not freed.
+     *
+     * @param tree the tree, may be NULL
+     */
+    static void recycle(GrammarTree *tree) {
+      if(!tree) return;
+      std::vector<GrammarTree*> &free = pool();
+      if(free.size() < pool_size) {
+	tree->clear();
+	free.push_back(tree);
+      }
+      else delete tree;
+    }
   
     /**
      * Adds a reuction rule to the back of the current tree
@@ -104,12 +167,23 @@ namespace grammar {
      */
     void reduce(Reduce::ActionType s) { grammar.push_back<Reduce>()->set_action( s ); }
 
+    /**
+     * Adds an already constructed reduction (usually one of the typed ReduceWith/ReduceString/ReduceThunk) to the back of
+     * the current tree.  The tree takes the pointer.
+     *
+     * @param r reduction rule to add
+     */
+    void reduce(Reduce *r) { grammar.push_back( static_cast<Rule*>(r) ); }
+
     //! add a rule to scan for a particular pattern
     void scan(Pattern *m) {
       Until *til = grammar.push_back<Until>();
       til->set_pattern(m);
     }
 
+    //! add a scanner which doesn't use a regex (the tree takes the pointer)
+    void scan(Scan *s) { grammar.push_back( static_cast<Rule*>(s) ); }
+
     /**
      * returns the data of the current tree.
      * The caller of this member is responsible for memory managment of returned Rules.
@@ -135,32 +209,17 @@ namespace grammar {
       grammar.push_back<Label>(Label("post-branch"));
     }
     
+    /**
+     * add the scanner r (and what follows it) as a case of the active branch.
+     *
+     * @param r an Until, Otherwise or Branch (see Rule::add_as_case); it is freed once its case is added.
+     */
     void push_case(Rule *r) {
-      Until *unt = nullptr;
-      Branch *brn = nullptr;
-      Otherwise *other = nullptr;
-
-      /* if r is a branch, adopt all its cases */
-      if( (brn = dynamic_cast<Branch*>(r)) )
-	copy( brn->get_case_vector().begin(), brn->get_case_vector().end()
-	      , back_inserter( active_branch()->get_case_vector() ) );
-    
-      /* if r is an Until, use that as a case */
-      else if( (unt = dynamic_cast<Until*>(r))  ) {
-	active_branch()->add_branch(unt->get_pattern()
-				    , unt->get_default() );
-      }
+      /* if it's not an Until, Otherwise or a Branch, I don't know how to add it on as a case. */
+      if( !r->add_as_case( active_branch() ) )
+	throw std::runtime_error("Case being pushed to a grammar branch must begin with a scanner");
 
-      else if( (other = dynamic_cast<Otherwise*>(r) ) ) {
-	active_branch()->add_default( r->get_default() );
-      }
-
-      /* if it's not an Until or a Branch, I don't know how to add it on as a case. */
-      else throw std::runtime_error("Case being pushed to a grammar branch must begin with a scanner");
-    
-      if(unt != nullptr) delete unt;    /* I've got the patterns and rule from my scanner, it should be safe to free it. */
-      if(brn != nullptr) delete brn;
-      if(other != nullptr) delete other;
+      delete r;    /* I've got the patterns and rule from my scanner, it should be safe to free it. */
     }
 
     /**
@@ -169,7 +228,8 @@ namespace grammar {
      * form of push_branch() or re() on the argument tree)
      * 
      * @param tree the grammar of the case I'm adding.  First item after the root_ label _must_ be a re type.
-     * @post the branch has been added, and it will continue to the active_branch_ "post-branch" label
+     * @post the branch has been added, and it will continue to the active_branch_ "post-branch" label; tree has been
+     *   recycled
      */
     void push_case(GrammarTree *tree) {
       using namespace std;
@@ -184,6 +244,7 @@ namespace grammar {
     
       /* keep the tree from deleting my newly aquired branch */
       tree->release_grammar();
+      recycle(tree);
     }
 
     /**
@@ -192,29 +253,29 @@ namespace grammar {
      * @param tree
      */
     void merge_tables(GrammarTree *tree) {
-      UnresolvedSymbolTable::iterator merging;
-	
       /* resolve any gotos with the enclosed labels */
       resolve(_unresolved, tree->environment_);
       /* now resolve any of the new branches goto's at the current scope */
       resolve(tree->_unresolved, environment_);
 
-      /* finish by merging symbol tables */
-      environment_.insert(tree->environment_.begin(), tree->environment_.end());
+      /* finish by merging symbol tables, always the smaller into the larger (my labels win over tree's) */
+      if(environment_.size() < tree->environment_.size()) {
+	environment_.swap(tree->environment_);
+	for(auto &defined : tree->environment_) environment_[defined.first] = defined.second;
+      }
+      else environment_.insert(tree->environment_.begin(), tree->environment_.end());
+      tree->environment_.clear();
     
       /* the unresolved table is more complex to merge because I have to grow the patch list as I go. */
+      if(_unresolved.size() < tree->_unresolved.size()) _unresolved.swap(tree->_unresolved);
       for(auto itr = tree->_unresolved.begin(); itr != tree->_unresolved.end(); ++itr ) {
-	  merging = _unresolved.find(itr->first);
+	PatchList &merging = _unresolved[itr->first];
 	
-	  /* if unresolved already has this key, I need to merge the patch-lists  */
-	  if( merging != _unresolved.end() ) {
-	    copy(itr->second.begin(), itr->second.end(),
-		 back_inserter( merging->second ));
-	  }
-
-	  /* if the key doesn't exist, insert it. */
-	  else (_unresolved[itr->first]).swap(itr->second);
-	}
+	/* if unresolved already has this key, I need to merge the patch-lists  */
+	if( merging.empty() ) merging.swap(itr->second);
+	else merging.insert(merging.end(), itr->second.begin(), itr->second.end());
+      }
+      tree->_unresolved.clear();
     }
 
     /**
@@ -234,11 +295,12 @@ namespace grammar {
     /**
      * takes tree's internal data using release()
      * 
-     * @param tree the tree to append
+     * @param tree the tree to append, which is recycled
      */
     void append(GrammarTree *tree) {
       merge_tables(tree);
       grammar.append(&tree->grammar);
+      recycle(tree);
     }
 
     /**
@@ -284,6 +346,16 @@ namespace grammar {
       environment_[name] = lab;
     }
 
+    /**
+     * the Label defined with name
+     *
+     * @return the label, or nullptr if there isn't one
+     */
+    Label* find_label(const std::string &name) {
+      SymbolTable::iterator found = environment_.find(name);
+      return found == environment_.end() ? nullptr : found->second;
+    }
+
     /**
      * Invoke the recursive printer on every in-tree element and (breifly) print out
      * all unresolved symbols (Goto's pending a destination).
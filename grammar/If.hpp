@@ -6,9 +6,9 @@
  * Created on Nov 20, 2012
  */
 
-#include <functional>
 #include <string>
 
+#include "./Action.hpp"
 #include "./Reduce.hpp"
 #include "./SimpleGetSetDefault.hpp"
 
@@ -17,13 +17,13 @@ namespace grammar {
    * Follow a branch if some C++ expression evaluates to true.
    */
   class If : public SimpleGetSetDefault {
-    std::function<bool ()> _test; /**< predicate function. */
+    Action<bool ()> _test;	  /**< predicate function. */
     Rule *_consiquent;		  /**< rule to follow if the predicate is satisfied. */
   public:
     /**
      * Construct an If object.
      */
-    If(std::function<bool ()> test, Rule *consiquent) 
+    If(Action<bool ()> test, Rule *consiquent) 
       : _test(test) , _consiquent(consiquent) {}
 
     /**
@@ -44,6 +44,14 @@ namespace grammar {
      */
     std::string str() { return "<if>"; }
 
+    /**
+     * the consiquent and the default
+     */
+    void for_successors(const std::function<void (Rule*)> &fn) {
+      if(_consiquent) fn(_consiquent);
+      if( get_default() ) fn( get_default() );
+    }
+
   };
 }
 
@@ -0,0 +1,189 @@
+#ifndef GRAMMAR_INCREMENTAL_HPP
+#define GRAMMAR_INCREMENTAL_HPP
+/**
+ * @file grammar/Incremental.hpp
+ *
+ * Parses a buffer which is edited and parsed again, over and over (a file open in an editor), re-parsing only around
+ * each edit.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "./Parser.hpp"
+#include "./Columns.hpp"
+
+namespace grammar {
+  /**
+   * Keeps a text, parsed a line at a time (each line without its newline, as foreach_line would feed it), and the
+   * records of its reductions (see TokenColumns; offsets are into text()).  While parsing it marks where the Parser is
+   * at the start of a line every so many characters, with a checkpoint of its state (see Parser::save_checkpoint).
+   *
+   * After an edit the parse starts again from the last mark before it.  Once it is past the edit, at a line where the
+   * old parse left a mark, it compares states: if the Parser is just where it was, the rest of the old parse still
+   * holds, so it stops there and keeps the old records (moved by the change in length).  So the scanning an edit costs
+   * is the size of the edit plus the distance between marks, not the size of the text; what's left is copying the
+   * records.
+   *
+   * The reductions' hooks aren't called: the records are the output.  If a line throws (a SyntaxError, say), the
+   * records stop there and the exception is passed on; the next edit parses on from a mark before it.
+   */
+  class IncrementalParser {
+    class Mark {
+    public:
+      std::size_t offset;	/**< start of a line in the text */
+      std::size_t tokens;	/**< records before it */
+      std::string state;	/**< the Parser there (see Parser::save_checkpoint) */
+    };
+
+    Parser _parse;
+    std::size_t _interval;	/**< least characters between marks */
+    std::string _text;
+    TokenColumns _tokens;
+    std::vector<Mark> _marks;	/**< in order of offset; the first is at 0 */
+    std::size_t _reparsed;	/**< see reparsed */
+
+    std::string state() {
+      std::ostringstream out;
+      _parse.save_checkpoint(out, 0);
+      return out.str();
+    }
+
+    /* append records [first, last) of from, moving their offsets by delta */
+    static void append(TokenColumns &to, const TokenColumns &from, std::size_t first, std::size_t last
+		       , std::ptrdiff_t delta = 0) {
+      for(std::size_t i = first; i < last; ++i) {
+	to.offset.push_back(from.offset[i] + delta);
+	to.length.push_back(from.length[i]);
+	to.capture.push_back(from.capture[i]);
+	to.rule.push_back(from.rule[i]);
+      }
+    }
+
+    /**
+     * parse from the last mark to the end of the text, marking as I go, unless from the line at rejoin on the Parser
+     * is where it was at one of after (marks of the old parse, moved to where their lines are now).
+     *
+     * @param fresh gets the records made
+     * @return the mark of after the parse rejoined at, or after.size() if it went to the end
+     */
+    std::size_t run(TokenColumns &fresh, std::size_t rejoin, const std::vector<Mark> &after) {
+      std::istringstream saved(_marks.back().state);
+      _parse.restore_checkpoint(saved);
+
+      std::size_t start = _marks.back().offset, base = _marks.back().tokens, next = 0;
+      std::string line;
+      for(std::size_t p = start; p < _text.size(); ) {
+	if(p != start) {
+	  if(p >= rejoin) {
+	    while(next < after.size() && after[next].offset < p) ++next;
+	    if(next < after.size() && after[next].offset == p && after[next].state == state()) {
+	      _reparsed = p - start;
+	      return next;
+	    }
+	  }
+	  if(p - _marks.back().offset >= _interval)
+	    _marks.push_back( Mark{p, base + fresh.size(), state()} );
+	}
+
+	const char *newline = static_cast<const char*>( std::memchr(&_text[p], '\n', _text.size() - p) );
+	std::size_t end = newline ? newline - _text.data() : _text.size();
+	line.assign(_text, p, end - p);
+	fresh.position = p;
+	_parse.push(line, fresh, false);
+	p = end + 1;
+      }
+      _reparsed = _text.size() - start;
+      return after.size();
+    }
+  public:
+    /**
+     * @param def the grammar (anything Parser::sink takes)
+     * @param interval least characters between marks: more marks cost memory, fewer cost re-parsing after an edit
+     */
+    template<class Grammar>
+    explicit IncrementalParser(Grammar &&def, std::size_t interval = 4096)
+      : _interval(interval ? interval : 1), _reparsed(0) {
+      _parse.sink( std::forward<Grammar>(def) );
+      set_text( std::string() );
+    }
+
+    IncrementalParser(const IncrementalParser&) = delete;
+
+    /**
+     * parse text from scratch
+     */
+    void set_text(const std::string &text) {
+      _text = text;
+      _tokens = TokenColumns();
+      _parse.reset();
+      _marks.assign( 1, Mark{0, 0, state()} );
+      run(_tokens, _text.size(), std::vector<Mark>());
+      _tokens.position = _text.size();
+    }
+
+    /**
+     * replace erase characters of the text from at with insert, and parse again around it
+     *
+     * @throw std::out_of_range if at is past the end of the text
+     */
+    void edit(std::size_t at, std::size_t erase, const std::string &insert) {
+      if(at > _text.size()) throw std::out_of_range("IncrementalParser::edit past the end of the text");
+      erase = std::min(erase, _text.size() - at);
+      _text.replace(at, erase, insert);
+      std::ptrdiff_t delta = std::ptrdiff_t( insert.size() ) - std::ptrdiff_t(erase);
+
+      /* the last mark at or before the edit; the parse before it stands */
+      std::size_t keep = std::upper_bound(_marks.begin(), _marks.end(), at
+					  , [](std::size_t at, const Mark &m) { return at < m.offset; }) - _marks.begin();
+      std::vector<Mark> after;
+      for(std::size_t i = keep; i < _marks.size(); ++i)
+	if(_marks[i].offset >= at + erase) {
+	  after.push_back( std::move(_marks[i]) );
+	  after.back().offset += delta;
+	}
+      _marks.resize(keep);
+
+      TokenColumns old, fresh;
+      std::swap(old, _tokens);
+      std::size_t base = _marks.back().tokens;
+      std::size_t rejoined = after.size();
+      try {
+	rejoined = run(fresh, at + insert.size(), after);
+      } catch(...) {
+	append(_tokens, old, 0, base);
+	append(_tokens, fresh, 0, fresh.size());
+	throw;
+      }
+
+      _tokens.reserve( base + fresh.size() + (rejoined < after.size() ? old.size() - after[rejoined].tokens : 0) );
+      append(_tokens, old, 0, base);
+      append(_tokens, fresh, 0, fresh.size());
+      if(rejoined < after.size()) {
+	std::ptrdiff_t moved = std::ptrdiff_t( _tokens.size() ) - std::ptrdiff_t( after[rejoined].tokens );
+	append(_tokens, old, after[rejoined].tokens, old.size(), delta);
+	for(std::size_t i = rejoined; i < after.size(); ++i) {
+	  after[i].tokens += moved;
+	  _marks.push_back( std::move(after[i]) );
+	}
+      }
+      _tokens.position = _text.size();
+    }
+
+    /** @return the text as edited */
+    const std::string& text() const { return _text; }
+
+    /** @return the records of the reductions made parsing text() */
+    const TokenColumns& tokens() const { return _tokens; }
+
+    /** @return characters scanned by the last edit (or set_text) */
+    std::size_t reparsed() const { return _reparsed; }
+  };
+}
+
+#endif
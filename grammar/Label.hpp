@@ -45,9 +45,9 @@ namespace grammar {
     /**
      * gets the name of label
      * 
-     * @return copy of the name string
+     * @return the name
      */
-    std::string get_name() {
+    const std::string& get_name() const {
       return name_;
     }
   
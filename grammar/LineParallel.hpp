@@ -0,0 +1,233 @@
+#ifndef GRAMMAR_LINEPARALLEL_HPP
+#define GRAMMAR_LINEPARALLEL_HPP
+/**
+ * @file grammar/LineParallel.hpp
+ *
+ * Parses the lines of a large input on several threads, for grammars which start over at every line (log formats,
+ * command records), while the actions still see the reductions in input order on the calling thread.
+ */
+
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./Parser.hpp"
+
+namespace grammar {
+  /**
+   * Splits its input into blocks of whole lines and parses the blocks on a pool of worker threads, each with a Parser
+   * of its own copy of the grammar.  Each line is parsed from the start of the grammar, like a line fed to a fresh
+   * Parser (without its newline).  If that leaves the parser waiting for more, the rest of the line is fed again with
+   * its newline, for grammars which end a line with a case like ^\\s*$ or \\n.  The workers only scan: their
+   * reductions are queued (see Parser::batch_reductions) and applied by the calling thread, block by block in input
+   * order, so the actions run as if the lines had been parsed one after another (though after the scanning, so
+   * conditions mustn't depend on them).
+   *
+   * A grammar can be declared line-stateless, or checked: then a line which leaves the parser anywhere but back at
+   * the start (ignoring labels and gotos) or at the end of the grammar, even after its newline, is an error.
+   *
+   * If a line throws (a SyntaxError, say), the reductions of the lines before it are applied and the exception is
+   * rethrown by operator(); later lines aren't reduced.
+   */
+  class LineParallel {
+  public:
+    enum Mode {
+      declared,			/**< every line is taken to start afresh */
+      checked			/**< every line has to leave the parser back at the start, or at the end */
+    };
+  private:
+    class Block {
+    public:
+      const char *begin, *end;
+      ReductionQueue queue;
+      std::exception_ptr error;
+      bool done;
+    };
+
+    Mode _mode;
+    std::size_t _block_size;	/**< characters per block (rounded up to a whole line) */
+    std::vector<std::unique_ptr<Parser> > _parsers; /**< one for each worker */
+    std::vector<std::thread> _workers;
+
+    std::mutex _lock;
+    std::condition_variable _work, _finished;
+    std::vector<std::unique_ptr<Block> > _blocks; /**< the input being parsed */
+    std::size_t _next;		/**< next block for a worker to take */
+    bool _quit;
+
+    void parse_block(Parser &parse, Block &block) {
+      std::string line;
+      parse._defer = &block.queue;
+      try {
+	for(const char *p = block.begin; p < block.end; ) {
+	  const char *newline = static_cast<const char*>( std::memchr(p, '\n', block.end - p) );
+	  if(!newline) newline = block.end;
+
+	  line.assign(p, newline);
+	  parse.reset();
+	  parse(line);
+	  if( !parse.is_leaf() && !parse.at_start() ) {
+	    /* waiting for the end of the line (a case like ^\\s*$ or \\n): give it what's left, and the newline */
+	    line.push_back('\n');
+	    parse(line);
+	  }
+	  if(_mode == checked && !parse.is_leaf() && !parse.at_start())
+	    throw std::runtime_error( "LineParallel: grammar isn't line-stateless; the parser didn't get back to the start "
+				      "after line: " + std::string(p, newline) );
+	  p = newline + 1;
+	}
+      } catch(...) {
+	block.error = std::current_exception();
+      }
+      parse._defer = nullptr;
+    }
+
+    void work(Parser &parse) {
+      for(;;) {
+	Block *block;
+	{
+	  std::unique_lock<std::mutex> lock(_lock);
+	  _work.wait(lock, [this]() { return _quit || _next < _blocks.size(); });
+	  if(_quit) return;
+	  block = _blocks[_next++].get();
+	}
+
+	parse_block(parse, *block);
+
+	{
+	  std::lock_guard<std::mutex> lock(_lock);
+	  block->done = true;
+	}
+	_finished.notify_all();
+      }
+    }
+
+    /* stop handing out blocks, and wait for those taken */
+    void abandon() {
+      std::unique_lock<std::mutex> lock(_lock);
+      std::size_t taken = _next;
+      _next = _blocks.size();
+      _finished.wait(lock, [&]() {
+	  for(std::size_t i = 0; i < taken; ++i) if( !_blocks[i]->done ) return false;
+	  return true;
+	});
+      _blocks.clear();
+      _next = 0;
+    }
+  public:
+    /**
+     * @param grammar makes the grammar; called once for each worker, here on the calling thread
+     * @param threads number of workers (0 for one per core)
+     * @param mode see Mode
+     * @param block_size characters of input handed to a worker at once
+     */
+    LineParallel(const std::function<DefineGrammar ()> &grammar, unsigned threads = 0, Mode mode = checked
+		 , std::size_t block_size = 1 << 16)
+      : _mode(mode), _block_size(block_size ? block_size : 1), _next(0), _quit(false) {
+      if(!threads) threads = std::thread::hardware_concurrency();
+      if(!threads) threads = 1;
+
+      for(unsigned i = 0; i < threads; ++i) {
+	_parsers.emplace_back(new Parser);
+	_parsers.back()->sink( grammar() );
+	_parsers.back()->batch_reductions(true);
+      }
+      for(unsigned i = 0; i < threads; ++i)
+	_workers.push_back( std::thread(&LineParallel::work, this, std::ref(*_parsers[i])) );
+    }
+
+    LineParallel(const LineParallel&) = delete;
+
+    ~LineParallel() {
+      {
+	std::lock_guard<std::mutex> lock(_lock);
+	_quit = true;
+      }
+      _work.notify_all();
+      for(auto &t : _workers) t.join();
+    }
+
+    /** @return the number of workers */
+    std::size_t threads() const { return _workers.size(); }
+
+    /**
+     * parse size characters of lines (the last needn't end in a newline), applying the reductions on this thread
+     */
+    void operator()(const char *data, std::size_t size) {
+      const char *end = data + size;
+      {
+	std::lock_guard<std::mutex> lock(_lock);
+	for(const char *p = data; p < end; ) {
+	  const char *q = end;
+	  if(std::size_t(end - p) > _block_size) {
+	    q = static_cast<const char*>( std::memchr(p + _block_size, '\n', end - p - _block_size) );
+	    q = q ? q + 1 : end;
+	  }
+	  _blocks.emplace_back(new Block);
+	  _blocks.back()->begin = p;
+	  _blocks.back()->end = q;
+	  _blocks.back()->done = false;
+	  p = q;
+	}
+	_next = 0;
+      }
+      _work.notify_all();
+
+      for(std::size_t i = 0; i < _blocks.size(); ++i) {
+	Block *block;
+	{
+	  std::unique_lock<std::mutex> lock(_lock);
+	  block = _blocks[i].get();
+	  _finished.wait(lock, [block]() { return block->done; });
+	}
+
+	try {
+	  block->queue.apply();
+	  if(block->error) std::rethrow_exception(block->error);
+	} catch(...) {
+	  abandon();
+	  throw;
+	}
+      }
+
+      std::lock_guard<std::mutex> lock(_lock);
+      _blocks.clear();
+      _next = 0;
+    }
+
+    void operator()(const std::string &text) { (*this)(text.data(), text.size()); }
+
+    /**
+     * parse all of in, reading window characters at a time
+     */
+    void operator()(std::istream &in, std::size_t window = 1 << 22) {
+      std::string buffer;
+      std::size_t carried = 0;	/* characters of a line begun in the last window */
+      while(in) {
+	buffer.resize(carried + window);
+	in.read(&buffer[carried], window);
+	buffer.resize( carried + in.gcount() );
+
+	std::size_t last = buffer.rfind('\n');
+	if(last == std::string::npos) {
+	  carried = buffer.size();
+	  continue;
+	}
+	(*this)(buffer.data(), last + 1);
+	buffer.erase(0, last + 1);
+	carried = buffer.size();
+      }
+      if( !buffer.empty() ) (*this)(buffer);
+    }
+  };
+}
+
+#endif
@@ -7,36 +7,157 @@
  */
 #include <boost/regex.hpp>
 #include <string>
+#include <vector>
+#include <utility>
 
 namespace grammar {
   /**
    * boost::.match are invalidated when the string to which they refer is mutated, therefore I'm bundling together string and smatch
+   *
+   * A copied Match can't keep the smatch (it points into the original's string), so copies hold their captures as
+   * (position, length) spans instead.  The accessors below work the same for both.
    */
   class Match {
     friend class Pattern;
+  public:
+    typedef std::pair<std::ptrdiff_t, std::ptrdiff_t> Span; /**< position and length of a capture; position < 0 if unmatched */
   private:
     std::string _input;
+    std::size_t _lead;		/**< characters before match[0] which still belong to the whole match (see Branch::factor_prefixes) */
+    std::vector<Span> _spans;	/**< captures, when they are not held by match */
+    bool _use_spans;		/**< true if _spans rather than match holds the captures */
+    std::string _scratch;	/**< buffer for scratch(), kept so a capture needn't allocate each time */
+    bool _open_end;		/**< more of the stream may follow the input (see set_open_end) */
+
+    void copy_spans(std::vector<Span> &spans) const {
+      spans.clear();
+      for(std::size_t i = 0; i < size(); ++i)
+	spans.push_back( Span(position(i), length(i)) );
+    }
   public:
     boost::smatch match;
 
-    Match() {}
-    Match(const Match& m) : _input(m._input) , match(m.match) {}
+    Match() : _lead(0), _use_spans(false), _open_end(false) {}
+    Match(const Match& m) : _input(m._input) , _lead(0), _use_spans(true), _open_end(false) { m.copy_spans(_spans); }
+
+    Match& operator=(const Match& m) {
+      if(&m != this) {
+	_input = m._input;
+	m.copy_spans(_spans);
+	_lead = 0;
+	_use_spans = true;
+	match = boost::smatch();
+      }
+      return *this;
+    }
 
     Match& set_input(const std::string &str) {
       _input = str;
+      _lead = 0;
+      _use_spans = false;
       return *this;
     }
 
-    std::string operator[](int index) {
-      return match[index].str();
+    /**
+     * make the span of input() from position the whole match, with no other captures (for scans which don't use a
+     * regex; see Scan)
+     */
+    Match& set_span(std::ptrdiff_t position, std::ptrdiff_t length) {
+      _spans.assign( 1, Span(position, length) );
+      _use_spans = true;
+      return *this;
     }
 
-    std::string str() { return match.str(); }
-    std::string suffix() { return match.suffix(); }
+    /**
+     * add str to the end of input(), for a Match whose captures are spans (which stay where they are)
+     */
+    Match& append_input(const std::string &str) {
+      _input.append(str);
+      return *this;
+    }
+
+    /**
+     * make the spans [first, last) of input() the captures, in order
+     */
+    template<class Iterator>
+    Match& set_spans(Iterator first, Iterator last) {
+      _spans.assign(first, last);
+      _lead = 0;
+      _use_spans = true;
+      return *this;
+    }
+
+    /**
+     * say whether more of the stream may follow the input being scanned (see Parser::push).  If so, a match which runs
+     * to the end of its input might have gone further with more, so the scan waits for more rather than take it.
+     */
+    Match& set_open_end(bool open) {
+      _open_end = open;
+      return *this;
+    }
+
+    /** true if a match ending at end, in an input of size characters, has to wait for more (see set_open_end) */
+    bool cut_short(std::size_t end, std::size_t size) const { return _open_end && end >= size; }
+
+    /** the string the captures refer to */
+    const std::string& input() const { return _input; }
 
-    /** trivial wrapper of boost::match begin */
+    /** number of captures, including the whole match */
+    std::size_t size() const { return _use_spans ? _spans.size() : match.size(); }
+
+    /** true if capture index took part in the match */
+    bool matched(std::size_t index) const {
+      if(_use_spans) return index < _spans.size() && _spans[index].first >= 0;
+      return index < match.size() && match[index].matched;
+    }
+
+    /** offset of capture index in input() (-1 if unmatched) */
+    std::ptrdiff_t position(std::size_t index = 0) const {
+      if(!matched(index)) return -1;
+      if(_use_spans) return _spans[index].first;
+      /* match's positions are relative to where the search began, _lead characters into the input */
+      return index == 0 ? match.position(index) : match.position(index) + _lead;
+    }
+
+    /** length of capture index */
+    std::ptrdiff_t length(std::size_t index = 0) const {
+      if(!matched(index)) return 0;
+      if(_use_spans) return _spans[index].second;
+      return match.length(index) + (index == 0 ? _lead : 0);
+    }
+
+    std::string operator[](int index) const {
+      if(!matched(index)) return std::string();
+      return _input.substr(position(index), length(index));
+    }
+
+    /**
+     * capture index, copied into a buffer I keep (so once the buffer has grown to fit, it doesn't allocate)
+     *
+     * @return the capture; valid until scratch is next called, or I change
+     */
+    const std::string& scratch(int index) {
+      if(!matched(index)) _scratch.clear();
+      else _scratch.assign(_input, position(index), length(index));
+      return _scratch;
+    }
+
+    std::string str() const { return (*this)[0]; }
+
+    std::string suffix() const {
+      if(!matched(0)) return std::string();
+      return _input.substr( suffix_position() );
+    }
+
+    /**
+     * offset of suffix() in input(): a scan consumes its match from its input (a copy of input()) with
+     * input.erase(0, suffix_position()), which unlike input = suffix() doesn't allocate
+     */
+    std::size_t suffix_position() const { return matched(0) ? position(0) + length(0) : _input.size(); }
+
+    /** trivial wrapper of boost::match begin (only meaningful for a Match which hasn't been copied) */
     decltype(match.begin()) begin() { return match.begin(); }
-    
+
     /** trivial wrapper of boost::match end */
     decltype(match.end()) end() { return match.end(); }
   };
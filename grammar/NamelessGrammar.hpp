@@ -40,6 +40,14 @@ namespace grammar {
     return (DefineGrammar()).re_i(match_patttern);
   }
 
+  /**
+   * scanners which don't use a regex (see DefineGrammar::lit and friends)
+   */
+  DefineGrammar lit(const std::string &literal) { return (DefineGrammar()).lit(literal); }
+  DefineGrammar skip_to(char c) { return (DefineGrammar()).skip_to(c); }
+  DefineGrammar one_of(const CharClass &cls) { return (DefineGrammar()).one_of(cls); }
+  DefineGrammar take_while(const CharClass &cls) { return (DefineGrammar()).take_while(cls); }
+
   DefineGrammar label(const std::string &ll) { return (DefineGrammar()).label(ll); }
 
   DefineGrammar otherwise() {
@@ -7,36 +7,221 @@
  *
  */
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_set>
+
 #include "./DefineGrammar.hpp"
+#include "./CheckProgress.hpp"
+#include "./Budget.hpp"
+#include "./ReductionQueue.hpp"
+#include "./Checkpoint.hpp"
 
 namespace grammar {
+  class GrammarSlot;
+  class Tokens;
+  class TokenColumns;
+
+  /**
+   * deleter for a sunk grammar: frees every rule reachable from its start, and their patterns, along with the tree (which
+   * only holds the ends of the chain).
+   */
+  class DeleteGrammar {
+  public:
+    void operator()(GrammarTree *tree) const {
+      std::vector<Rule*> rules;
+      std::unordered_set<Pattern*> patterns;
+
+      if(tree->begin()) {
+	WalkRules walker;
+	walker.walk(tree->begin(), [&](Rule *r) {
+	    Until *until;
+	    Branch *branch;
+	    rules.push_back(r);
+	    if( (until = dynamic_cast<Until*>(r)) && until->get_pattern() )
+	      patterns.insert( until->get_pattern() );
+	    else if( (branch = dynamic_cast<Branch*>(r)) )
+	      branch->for_each_pattern( [&](Pattern *p) { patterns.insert(p); } );
+	  });
+      }
+
+      for(auto r : rules) delete r;
+      for(auto p : patterns) delete p;
+      delete tree;
+    }
+  };
+
   /**
    * Should be constructed by DefineGrammar.  A generated parser which expects
    * to be fed strings.  It will apply the rules defined by DefineGrammar
    * until the string it is applied to is empty.
    *
    * Parser is a sink for a DefineGrammar's GrammarTree.  Parser expects to have exclusive non-transferable
-   * ownership of the GrammarTree object.  When the parser dies, it simply deletes the grammar.
+   * ownership of the GrammarTree object.  When the parser dies, it simply deletes the grammar.  Alternatively a Parser
+   * can follow a GrammarSlot, sharing the grammar published there with other Parsers (see attach).
    *
    * It maintains state between application so that it can be fed files one line at a time.
    */
   class Parser {
     friend class DefineGrammar;
-    GrammarTree *_root;	   /**< starting point for the grammar, used for resets and printing. */
+    friend class GrammarSet;
+    friend class Tokens;
+    friend class LineParallel;
+    friend class SpeculativeParser;
+    std::shared_ptr<GrammarTree> _root; /**< starting point for the grammar, used for resets and printing. */
     Rule *_rule;	   /**< current rule to scan or reduce with */
     Match _scanned; /**< between invocations the Parser may have scanned some characters which have not yet 
 		       been reduced  */
+    std::size_t _stall_limit;	/**< most rules in a row which may apply without consuming input (0 for no limit) */
+    GrammarSlot *_slot;		/**< where new versions of the grammar are published, if I follow one */
+    std::size_t _version;	/**< version of _slot's grammar that _root is */
+    std::string _safe_label;	/**< label at which I may change to a newly published grammar mid-stream */
+    bool _holding;		/**< the last rule applied is waiting for more of the input it was given (see push) */
+    bool _batch;		/**< queue reductions, to apply at the end of each call (see batch_reductions) */
+    ReductionQueue _queue;	/**< reductions waiting for the end of the call */
+    ReductionQueue *_defer;	/**< if set, queue reductions here and leave them for the owner to apply */
+    std::unordered_map<Rule*, std::size_t> _ids; /**< see rule_id */
+    GrammarTree *_ids_for;	/**< the grammar _ids were worked out for */
+    std::size_t _input_index;	/**< see input_index */
+
+    /* take the published grammar, if I'm at the safe label and it has one too */
+    void switch_at_safe_label();
+
+    /* the rule rule_id numbers id (nullptr if none does) */
+    Rule* rule_at(std::size_t id) {
+      if(!_root) return nullptr;
+      rule_id( _root->begin() );	/* works out _ids */
+      for(auto &entry : _ids) if(entry.second == id) return entry.first;
+      return nullptr;
+    }
+
+    /* how many rules the grammar has: tells checkpoints of different grammars apart */
+    std::size_t rule_count() {
+      if(!_root) return 0;
+      rule_id( _root->begin() );	/* works out _ids */
+      return _ids.size();
+    }
+
+    static const char* checkpoint_magic() { return "gramckp1"; } /* first 8 bytes of a checkpoint */
+
+    /* the first rule from r which isn't a label or a goto */
+    static Rule* settle(Rule *r) {
+      for(std::size_t hops = 0; r && hops < 64; ++hops) {
+	GotoLabel *go;
+	if( (go = dynamic_cast<GotoLabel*>(r)) ) r = go->get_label();
+	else if( dynamic_cast<Label*>(r) && !dynamic_cast<Stop*>(r) ) r = r->get_default();
+	else break;
+      }
+      return r;
+    }
+
+    /* apply fn to each Branch of the grammar, always in the same order */
+    void for_branches(const std::function<void (Branch*)> &fn) {
+      if(!_root) return;
+      WalkRules walker;
+      walker.walk(_root->begin(), [&](Rule *r) {
+	  Branch *b = dynamic_cast<Branch*>(r);
+	  if(b) fn(b);
+	});
+    }
+
+    /* apply _rule once, and return it.  left is the shortest the input has been and stalled the rules applied since;
+       too many throws (see set_stall_limit). */
+    Rule* step(Match &scanned, std::string &input, bool &more_input_needed, std::size_t &left, std::size_t &stalled) {
+      Rule *applied = _rule;
+      _rule = (*_rule)(scanned, input, more_input_needed);
+      stepped(input, left, stalled);
+      return applied;
+    }
+
+    /* what follows moving on to _rule: changing grammars at the safe label and the stall check (see step) */
+    void stepped(const std::string &input, std::size_t &left, std::size_t &stalled) {
+      using namespace std;
+      if(_slot && !_safe_label.empty()) switch_at_safe_label();
+
+      if(input.size() < left) {
+	left = input.size();
+	stalled = 0;
+      }
+      else if(_stall_limit && ++stalled > _stall_limit) {
+	stringstream msg;
+	msg << "Parser applied " << _stall_limit << " rules without consuming input; stuck at "
+	    << (_rule ? _rule->str() : string("NULL"));
+	throw runtime_error(msg.str());
+      }
+    }
+
+    /* the trampoline: apply rules, starting from _rule, with scanned holding what's been matched, until more input is
+       needed or budget (if any) runs out */
+    ParseStatus apply_rules(Match &scanned, std::string &input, const Budget *budget) {
+      using namespace std;
+      bool more_input_needed = false;
+      size_t left = input.size()	/* shortest the input has been */
+	, stalled = 0			/* rules applied since it got shorter */
+	, start = input.size()
+	, steps = 0;
+
+      Rule *applied = nullptr;
+      while(_rule && !more_input_needed) {
+	if(budget) {
+	  ParseStatus status = budget->check(steps++, ptrdiff_t(start) - ptrdiff_t(input.size()));
+	  if(status != ParseStatus::finished) return status;
+	}
+	Reduce *reduce;
+	if( _batch && (reduce = dynamic_cast<Reduce*>(_rule)) ) {
+	  (_defer ? *_defer : _queue).push(reduce, scanned, start - input.size());
+	  applied = _rule;
+	  _rule = reduce->get_default();
+	  stepped(input, left, stalled);
+	  continue;
+	}
+	applied = step(scanned, input, more_input_needed, left, stalled);
+      }
+      _holding = more_input_needed && _rule == applied;
+      return ParseStatus::finished;
+    }
+
+    /* apply_rules, then the reductions it queued (see batch_reductions); more if more of the stream may follow input
+       (see push) */
+    ParseStatus run(Match &scanned, std::string &input, const Budget *budget = nullptr, bool more = false) {
+      scanned.set_open_end(more);
+      if(!_batch) return apply_rules(scanned, input, budget);
+      if(_defer) {
+	_defer->begin_call(input);
+	return apply_rules(scanned, input, budget);
+      }
+
+      _queue.begin_call(input);
+      ParseStatus status;
+      try {
+	status = apply_rules(scanned, input, budget);
+      } catch(...) {
+	_queue.apply();		/* the reductions before the error still happen */
+	throw;
+      }
+      _queue.apply();
+      return status;
+    }
   public:
+    static const std::size_t default_stall_limit = 100000; /**< see set_stall_limit */
+
     Parser(const Parser&) = delete; 	/**< forbidden. */
     /**
      * default construct empty
      */
-    Parser() : _root(nullptr), _rule(nullptr) {}
+    Parser() : _rule(nullptr), _stall_limit(default_stall_limit), _slot(nullptr), _version(0), _holding(false), _batch(false)
+      , _defer(nullptr), _ids_for(nullptr), _input_index(0) {}
 
     /**
-     * destructor destroys the grammar object.
+     * destructor destroys the grammar object (unless other Parsers following the same GrammarSlot still use it).
      */
-    ~Parser() { delete _root; }
+    ~Parser() = default;
 
     /**
      * parse a string untill it is consumed using the rules definined by my grammar.
@@ -44,12 +229,146 @@ namespace grammar {
      *
      * @param input the string to parse
      */
-    void operator()(std::string& input) {
-      using namespace std;
-      bool more_input_needed = false;
-      while(_rule && !more_input_needed)
-	_rule = (*_rule)(_scanned, input, more_input_needed);
+    void operator()(std::string& input) { run(_scanned, input); }
+
+    /**
+     * parse the next chunk of a stream, which needn't end on a line (or token) boundary.  If the parser stops on a scan
+     * still waiting for its match, what that scan was given stays in buffer, for the caller to append the next chunk
+     * to; otherwise buffer is emptied.  So a delimiter split across chunks is still found.  Until the end of the stream
+     * a scan whose match runs to the end of buffer (like \\w+ on a word cut in two) waits for more too, so the tokens
+     * don't depend on where the chunks were cut.  At the end of the stream push the rest with more false, to take
+     * them.
+     *
+     * @param buffer unparsed input followed by the new chunk
+     * @param more false if buffer runs to the end of the stream
+     */
+    void push(std::string &buffer, bool more = true) {
+      run(_scanned, buffer, nullptr, more);
+      if(!_holding) buffer.clear();
+    }
+
+    /**
+     * push within a budget.  If the budget runs out, buffer holds everything not yet parsed; push it again (with more
+     * appended or not) to carry on.
+     *
+     * @return as for operator()(input, budget)
+     */
+    ParseStatus push(std::string &buffer, const Budget &budget, bool more = true) {
+      ParseStatus status = run(_scanned, buffer, &budget, more);
+      if(status == ParseStatus::finished && !_holding) buffer.clear();
+      return status;
+    }
+
+    /**
+     * push, but instead of calling the reductions' hooks append a record of each reduction to out (defined in
+     * Columns.hpp)
+     *
+     * @param buffer unparsed input followed by the new chunk
+     * @param out columns to append to, kept for the whole stream (it tracks the stream offset)
+     * @param more false if buffer runs to the end of the stream
+     */
+    void push(std::string &buffer, TokenColumns &out, bool more = true);
+
+    /**
+     * Parse each of many short, independent inputs from the start of the grammar, as if each were given to a freshly
+     * reset Parser.  Several are parsed at once, a rule of each in turn, so the cache misses of one overlap the work on
+     * the others.  So reductions of different inputs are interleaved: an action can ask input_index() which input it
+     * is working on.  My own state (where I am in the grammar, what I've scanned) is left as it was.
+     *
+     * @param first, last the inputs (anything a std::string can be assigned from)
+     * @param lanes how many inputs to parse at once
+     */
+    template<class Iterator>
+    void parse_many(Iterator first, Iterator last, std::size_t lanes = 8) {
+      class Lane {
+      public:
+	Rule *rule;		/**< nullptr when the lane has no input */
+	Match scanned;
+	std::string input;
+	std::size_t index, left, stalled;
+      };
+      if(!_root) return;
+
+      std::vector<Lane> lane( lanes ? lanes : 1 );
+      std::size_t next = 0, busy = 0;
+      auto refill = [&](Lane &l) {
+	if(first == last) {
+	  l.rule = nullptr;
+	  return;
+	}
+	l.input = *first++;
+	l.rule = _root->begin();
+	l.index = next++;
+	l.left = l.input.size();
+	l.stalled = 0;
+	++busy;
+      };
+      for(auto &l : lane) refill(l);
+
+      Rule *saved = _rule;
+      std::size_t saved_index = _input_index;
+      try {
+	while(busy) {
+	  for(auto &l : lane) {
+	    if(!l.rule) continue;
+	    bool more_input_needed = false;
+	    _rule = l.rule;
+	    _input_index = l.index;
+	    step(l.scanned, l.input, more_input_needed, l.left, l.stalled);
+	    l.rule = _rule;
+	    if(!_rule || more_input_needed) {
+	      --busy;
+	      refill(l);
+	    }
+	  }
+	}
+      } catch(...) {
+	_rule = saved;
+	_input_index = saved_index;
+	throw;
+      }
+      _rule = saved;
+      _input_index = saved_index;
     }
+
+    /** @return while parse_many runs, the index of the input being parsed (for actions) */
+    std::size_t input_index() const { return _input_index; }
+
+    /**
+     * the reductions made parsing input, as a lazy range of Tokens (defined in Tokens.hpp)
+     *
+     * @param input the string to parse; left holding what hasn't been parsed when the iteration stops
+     */
+    Tokens tokens(std::string &input);
+
+    /**
+     * a number for each rule of the grammar: its position in a walk of the grammar from its start, so it is the same
+     * for every Parser of the same grammar definition.
+     *
+     * @return the id, or -1 if r isn't part of the grammar
+     */
+    std::size_t rule_id(Rule *r) {
+      if(_ids_for != _root.get()) {
+	_ids.clear();
+	_ids_for = _root.get();
+	if(_root) {
+	  WalkRules walker;
+	  walker.walk(_root->begin(), [&](Rule *rule) { _ids.insert( std::make_pair(rule, _ids.size()) ); });
+	}
+      }
+      std::unordered_map<Rule*, std::size_t>::iterator found = _ids.find(r);
+      return found == _ids.end() ? std::size_t(-1) : found->second;
+    }
+
+    /**
+     * parse within a budget.  When the budget runs out, input holds what hasn't been parsed and the Parser is left
+     * where it stopped, so calling again (with a new budget) carries on.
+     *
+     * @param input the string to parse; left holding the unparsed rest
+     * @param budget limits on the work done by this call
+     * @return finished if the input was used up (as operator()(input) would), otherwise why the parser stopped
+     */
+    ParseStatus operator()(std::string& input, const Budget &budget) { return run(_scanned, input, &budget); }
   
     /**
      * alternate form of operator(), parses a c-style string
@@ -77,11 +396,23 @@ namespace grammar {
     void print() { print(std::cout); }
 
     /**
-     * begins parsing the next line with the root of my GrammarTree object.
+     * begins parsing the next line with the root of my GrammarTree object.  A Parser following a GrammarSlot takes the
+     * latest grammar published there.
      * 
      * @post the parser will begin parsing the next input with its initial state.
      */
-    void reset() { _rule = _root->begin(); }
+    void reset();
+
+    /**
+     * follow the grammars published to slot, starting with the current one.  Each reset() picks up the latest grammar;
+     * with a safe_label, a stream also changes over mid-parse when it reaches that label (if the new grammar defines
+     * it).  A grammar is freed once no Parser is using it.
+     *
+     * @param slot where grammars are published; it has to outlive the Parser
+     * @param safe_label name of a label where the state of the old grammar doesn't matter, or "" to only change on reset
+     * @throw std::runtime_error if nothing has been published to slot
+     */
+    void attach(GrammarSlot &slot, const std::string &safe_label = std::string());
   
     /**
      * true if _rule is NULL (can't do anything with more strings until reset)
@@ -89,14 +420,165 @@ namespace grammar {
      */
     bool is_leaf() { return _rule == NULL; }
 
+    /**
+     * @return true if I'm where reset() would put me, give or take labels and gotos (so nothing is left over from the
+     * input parsed so far)
+     */
+    bool at_start() {
+      if(!_root) return !_rule;
+      return settle(_rule) == settle( _root->begin() );
+    }
 
     /**
-     * Takes control of a GrammarTree pointer from a DefineGrammar
-     * the && won't collapse unless I'm taking Grammar as a template parameter.
+     * backstop for the loops sink can't see: if more than limit rules apply in a row without consuming any input,
+     * operator() throws a std::runtime_error rather than spinning.
+     *
+     * @param limit the number of rules, or 0 to never give up
+     */
+    void set_stall_limit(std::size_t limit) { _stall_limit = limit; }
+
+    /**
+     * Queue reductions instead of applying each as it's reached, and apply the queue at the end of each call (when the
+     * input runs out, at a Stop, when a budget runs out, or before an exception leaves), so scanning and the actions
+     * each run in a loop of their own.  Off by default.  Only for grammars whose conditions (If) don't depend on what
+     * the actions do, since the actions run late.  Queued actions see their captures (operator[], position, length)
+     * but not the boost::smatch.
+     *
+     * @param on true to queue reductions
+     */
+    void batch_reductions(bool on) { _batch = on; }
+
+    /**
+     * Every Branch counts how often each of its cases is chosen.  This sorts the cases of each Branch by those counts,
+     * where the order doesn't matter to the result (see Branch::reorder_cases).
+     */
+    void reorder_cases() { for_branches( [](Branch *b) { b->reorder_cases(); } ); }
+
+    /**
+     * have every Branch reorder its cases as it goes (see Branch::set_reorder_interval)
+     *
+     * @param interval reorder after this many decisions of the Branch, 0 to stop reordering
+     */
+    void set_reorder_interval(std::size_t interval) {
+      for_branches( [=](Branch *b) { b->set_reorder_interval(interval); } );
+    }
+
+    /**
+     * write the case counts of every Branch, one line per Branch, so a later run can start with the same ordering
+     * (see load_profile).
+     *
+     * @param out stream to write to
+     */
+    void save_profile(std::ostream &out) {
+      for_branches( [&](Branch *b) {
+	  std::vector<std::size_t> hits = b->hits();
+	  for(std::size_t i = 0; i < hits.size(); ++i)
+	    out << (i ? " " : "") << hits[i];
+	  out << "\n";
+	});
+    }
+
+    /**
+     * read case counts written by save_profile (for the same grammar) and reorder the cases by them.
+     *
+     * @param in stream to read from
+     * @throw std::runtime_error if the profile doesn't fit the grammar
+     */
+    void load_profile(std::istream &in) {
+      for_branches( [&](Branch *b) {
+	  std::string line;
+	  std::vector<std::size_t> hits;
+	  std::size_t count;
+
+	  std::getline(in, line);
+	  std::stringstream fields(line);
+	  while(fields >> count) hits.push_back(count);
+
+	  if(hits.size() != b->hits().size())
+	    throw std::runtime_error("Parser profile doesn't match the grammar: wrong number of cases for a branch.");
+	  b->set_hits(hits);
+	  b->reorder_cases();
+	});
+    }
+
+    typedef std::function<void (std::ostream&)> SaveHook; /**< saves the actions' state with a checkpoint */
+    typedef std::function<void (std::istream&)> LoadHook; /**< loads what a SaveHook saved */
+
+    /**
+     * Snapshot where I am (my rule, what I've scanned but not reduced) to out, in a compact binary form (see
+     * Checkpoint.hpp), so a job which dies can carry on from here instead of starting over (see restore_checkpoint).
+     * Only between calls, when nothing is queued: after a line, say.  The Parser restoring it needs a grammar made by
+     * the same definition, since rules are saved by rule_id.
+     *
+     * @param out stream to write to (opened in binary mode)
+     * @param offset where in the input the next call's input starts, handed back by restore_checkpoint
+     * @param save called last, to save whatever the actions need to carry on (an element stack, say)
+     * @throw std::runtime_error if called in the middle of a call
+     */
+    void save_checkpoint(std::ostream &out, std::uint64_t offset, const SaveHook &save = SaveHook()) {
+      if( _defer || !_queue.empty() ) throw std::runtime_error("Parser can't checkpoint in the middle of a call");
+
+      out.write(checkpoint_magic(), 8);
+      checkpoint::write(out, rule_count());
+      checkpoint::write(out, _rule ? rule_id(_rule) + 1 : 0);
+      checkpoint::write(out, _holding);
+      checkpoint::write(out, offset);
+
+      checkpoint::write(out, _scanned.input());
+      checkpoint::write(out, _scanned.size());
+      for(std::size_t i = 0; i < _scanned.size(); ++i) {
+	checkpoint::write(out, _scanned.position(i) + 1); /* 0 for unmatched */
+	checkpoint::write(out, _scanned.length(i));
+      }
+      if(save) save(out);
+    }
+
+    /**
+     * pick up where a checkpoint written by save_checkpoint left off.  Feed me the input from the offset it returns.
+     *
+     * @param in stream to read from
+     * @param load called last, to load what the save hook saved
+     * @return the offset given to save_checkpoint
+     * @throw std::runtime_error if in isn't a checkpoint of this grammar
+     */
+    std::uint64_t restore_checkpoint(std::istream &in, const LoadHook &load = LoadHook()) {
+      char magic[8];
+      if( !in.read(magic, 8) || !std::equal(magic, magic + 8, checkpoint_magic()) )
+	throw std::runtime_error("not a Parser checkpoint");
+      if(checkpoint::read_number(in) != rule_count()) throw std::runtime_error("checkpoint is of a different grammar");
+
+      std::uint64_t id = checkpoint::read_number(in);
+      Rule *rule = id ? rule_at(id - 1) : nullptr;
+      if(id && !rule) throw std::runtime_error("checkpoint is of a different grammar");
+      bool holding = checkpoint::read_number(in);
+      std::uint64_t offset = checkpoint::read_number(in);
+
+      Match scanned;
+      scanned.set_input( checkpoint::read_string(in) );
+      std::vector<Match::Span> spans( checkpoint::read_number(in) );
+      for(auto &span : spans) {
+	span.first = std::ptrdiff_t( checkpoint::read_number(in) ) - 1;
+	span.second = checkpoint::read_number(in);
+      }
+      scanned.set_spans(spans.begin(), spans.end());
+
+      if(load) load(in);
+      _rule = rule;
+      _holding = holding;
+      _scanned = scanned;
+      return offset;
+    }
+
+
+    /**
+     * check a grammar and take it from def, ready to parse (used by sink and GrammarSlot::publish)
+     *
      * @param def DefineGrammar object I'm releasing
+     * @return the grammar, to be freed with DeleteGrammar
+     * @throw std::runtime_error if it has unresolved labels or may loop without consuming input
      */
     template<class Grammar>
-    void sink(Grammar &&def) {
+    static GrammarTree* prepare(Grammar &&def) {
       using namespace std;
       /* it would be nice if I could do this checking at compile time...  */
       if(!def._grammar->fully_resolvedP()) {
@@ -105,11 +587,105 @@ namespace grammar {
 	def._grammar->for_unresolved([&](const std::string& s) { msg.append(s).append(" ");});
 	throw std::runtime_error(msg);
       }
+
+      /* refuse grammars which could loop forever without consuming input */
+      std::vector<CheckProgress::Path> loops = CheckProgress( def._grammar->begin() ).loops();
+      if(!loops.empty())
+	throw std::runtime_error( CheckProgress::message(loops) );
     
-      _root = def.release_grammar();
-      _rule = _root->begin();
+      GrammarTree *tree = def.release_grammar();
+      factor_branches( tree->begin() ); /* share the work of cases which begin the same way */
+      return tree;
+    }
+
+    /**
+     * Takes control of a GrammarTree pointer from a DefineGrammar, freeing any grammar I had before.
+     * the && won't collapse unless I'm taking Grammar as a template parameter.
+     * @param def DefineGrammar object I'm releasing
+     */
+    template<class Grammar>
+    void sink(Grammar &&def) {
+      _root.reset( prepare(def), DeleteGrammar() );
+      _slot = nullptr;
       reset();
     }
   };
+
+  /**
+   * A grammar which can be replaced while Parsers are using it.  Parsers attached to the slot (Parser::attach) share
+   * the published grammar and change over to a new one at their next reset, or at their safe label.  Publishing is
+   * atomic, and each grammar is reference counted, so the old one is freed when the last Parser using it lets go; this
+   * works with Parsers on any number of threads, each Parser being used by one thread at a time.
+   *
+   * The rules of a shared grammar are shared too.  Parsing only reads them, but for the Branch hit counts, which are
+   * relaxed atomics, so every Parser's decisions are counted.  Reordering cases (Parser::reorder_cases,
+   * set_reorder_interval, load_profile) rearranges the rules themselves, so it's only for a grammar no other thread is
+   * using.
+   */
+  class GrammarSlot {
+    std::shared_ptr<GrammarTree> _tree;
+    std::atomic<std::size_t> _version;
+  public:
+    GrammarSlot() : _version(0) {}
+    GrammarSlot(const GrammarSlot&) = delete;
+
+    /**
+     * check def (as Parser::sink does) and make it the grammar for Parsers which reset from now on.
+     *
+     * @param def grammar to take
+     * @throw std::runtime_error as Parser::sink does; the published grammar is unchanged
+     */
+    template<class Grammar>
+    void publish(Grammar &&def) {
+      std::shared_ptr<GrammarTree> tree( Parser::prepare(def), DeleteGrammar() );
+      std::atomic_store(&_tree, tree);
+      _version.fetch_add(1, std::memory_order_release);
+    }
+
+    /**
+     * @return the latest grammar published
+     */
+    std::shared_ptr<GrammarTree> current() const { return std::atomic_load(&_tree); }
+
+    /**
+     * @return the number of grammars published so far
+     */
+    std::size_t version() const { return _version.load(std::memory_order_acquire); }
+  };
+
+  inline void Parser::reset() {
+    if(_slot) {
+      _version = _slot->version();
+      _root = _slot->current();
+    }
+    _rule = _root->begin();
+  }
+
+  inline void Parser::attach(GrammarSlot &slot, const std::string &safe_label) {
+    if( !slot.current() )
+      throw std::runtime_error("Parser cannot attach to a GrammarSlot before a grammar is published.");
+    _slot = &slot;
+    _safe_label = safe_label;
+    reset();
+  }
+
+  inline void Parser::switch_at_safe_label() {
+    if(_slot->version() == _version) return;
+
+    Label *here = dynamic_cast<Label*>(_rule);
+    GotoLabel *go;
+    if( !here && (go = dynamic_cast<GotoLabel*>(_rule)) ) here = go->get_label();
+    if( !here || here->get_name() != _safe_label ) return;
+
+    std::size_t version = _slot->version();
+    std::shared_ptr<GrammarTree> next = _slot->current();
+    Label *there = next->find_label(_safe_label);
+    _version = version;		/* without the label, wait for reset() */
+    if(there) {
+      _queue.apply();		/* while their rules are still there */
+      _root = next;
+      _rule = there;
+    }
+  }
 }
 #endif
@@ -1,6 +1,9 @@
 #ifndef GRAMMAR_PATTERN_HPP
 #define GRAMMAR_PATTERN_HPP
 
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <string>
 
 #include "./Match.hpp"
@@ -19,21 +22,62 @@ namespace grammar {
    * function for scanning input strings for matches.
    * 
    * Behavior implemented through overload at the call
+   *
+   * The regex is compiled the first time the Pattern is tried (a grammar usually defines many more patterns than a given
+   * input uses), so a malformed regular expression throws from find rather than from the constructor.  Compilation is
+   * thread-safe; setting the regex or flags isn't, and should be done while the grammar is being built.
    */
   class Pattern {
   private:
-    boost::regex _pattern;	/**< the regular expression Pattern is wrapping. */
+    boost::regex _pattern;	/**< the regular expression Pattern is wrapping (once compiled). */
     std::string _str;		/* keep a note of the string I've used to make the regex */
+    boost::regex::flag_type _flags; /**< flags to compile _str with */
+    std::unique_ptr<std::once_flag> _once; /**< guards compiling _pattern */
+    std::atomic<bool> _compiled;	   /**< _pattern is ready */
+
+    /* the compiled regex */
+    const boost::regex& regex() {
+      std::call_once(*_once, [this]() {
+	  _pattern.assign(_str, _flags);
+	  _compiled = true;
+	});
+      return _pattern;
+    }
+
+    /* forget the compiled regex (after changing the source or flags) */
+    void reset() {
+      _once.reset(new std::once_flag);
+      _compiled = false;
+    }
   public:
     Pattern() = delete;
-    Pattern(const Pattern& pat) = default;
+
+    /**
+     * copies the source and flags; the copy compiles on its own first use.
+     */
+    Pattern(const Pattern& pat)
+      : _str(pat._str), _flags(pat._flags), _once(new std::once_flag), _compiled(false) {}
+
     ~Pattern() = default;
     
     /**
      * simple constructor, build a pattern for regex based on str
      * @param str regular expression
      */
-    Pattern(const std::string &str) : _pattern(str), _str(str) {}
+    Pattern(const std::string &str)
+      : _str(str), _flags(boost::regex::normal), _once(new std::once_flag), _compiled(false) {}
+
+    /**
+     * compile now rather than on first use (to check the regular expression, or to keep the cost out of the first parse)
+     *
+     * @throw boost::regex_error if the regular expression is malformed
+     */
+    void compile() { regex(); }
+
+    /**
+     * @return true if the regex has been compiled
+     */
+    bool compiledP() const { return _compiled; }
   
     /**
      * check Pattern property
@@ -49,9 +93,40 @@ namespace grammar {
      * @return match position (or std::string::npos if no match)
      */
     bool find(Match &match) {
-      return boost::regex_search(match._input, match.match, _pattern);
+      match._lead = 0;
+      match._use_spans = false;
+      return boost::regex_search(match._input, match.match, regex());
     }
 
+    /**
+     * match only at offset in the Match's input.  The whole match (capture 0) is reported as starting from the
+     * beginning of the input, as though the characters before offset had been matched by the same pattern; Branch uses
+     * this to continue a case after a shared prefix.
+     *
+     * @param match holds the input, and receives the result
+     * @param offset where the match must begin
+     * @return true if there's a match at offset
+     */
+    bool find_at(Match &match, std::size_t offset) {
+      using namespace boost::regex_constants;
+      match._lead = offset;
+      match._use_spans = false;
+      std::string::const_iterator begin = match._input.cbegin();
+      return boost::regex_search(begin + offset, match._input.cend(), match.match, regex()
+				 , offset > 0 ? (match_continuous | match_prev_avail) : match_continuous
+				 , begin);
+    }
+
+    /**
+     * @return the source of the regular expression
+     */
+    const std::string& source() const { return _str; }
+
+    /**
+     * @return true if the pattern ignores case
+     */
+    bool icaseP() const { return _flags & boost::regex_constants::icase; }
+
     /**
      * a string representation of the Pattern, useful for printing and 
      * debugging.
@@ -62,7 +137,7 @@ namespace grammar {
       std::string s("/");
       s.append( _str ).append("/");
 
-      if( _pattern.flags() & boost::regex_constants::icase) s.append("i");
+      if( icaseP() ) s.append("i");
 
       return s;
     }
@@ -71,13 +146,19 @@ namespace grammar {
      * set _pattern
      * @param input pattern to use
      */
-    void set_regex(const std::string &input) { _pattern = input; }
+    void set_regex(const std::string &input) {
+      _str = input;
+      reset();
+    }
 
     /**
      * set the flags
      * @param flag flag to use
      */
-    void set_flag(boost::regex::flag_type flag) { _pattern = boost::regex(_str, flag); }
+    void set_flag(boost::regex::flag_type flag) {
+      _flags = flag;
+      reset();
+    }
   };
 }
 
@@ -0,0 +1,392 @@
+#ifndef GRAMMAR_PIPELINE_HPP
+#define GRAMMAR_PIPELINE_HPP
+/**
+ * @file grammar/Pipeline.hpp
+ *
+ * Reads input on a thread of its own, ahead of the parser, so reading and parsing overlap: a reader thread fills large
+ * buffers and hands them to the parsing thread through a lock-free single-producer, single-consumer ring.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <istream>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace grammar {
+  /**
+   * A fixed size queue between one producing thread and one consuming thread, without locks: each end only writes its
+   * own index, and reads the other's.
+   *
+   * @tparam T type of the items (cheap to copy)
+   */
+  template<class T>
+  class SpscRing {
+    std::vector<T> _slots;	/**< one more than the capacity, so full and empty differ */
+    alignas(64) std::atomic<std::size_t> _head; /**< next slot to pop (written by the consumer) */
+    alignas(64) std::atomic<std::size_t> _tail; /**< next slot to push (written by the producer) */
+  public:
+    /**
+     * @param capacity most items the ring holds at once
+     */
+    explicit SpscRing(std::size_t capacity) : _slots(capacity + 1), _head(0), _tail(0) {}
+
+    SpscRing(const SpscRing&) = delete;
+
+    /**
+     * add item, from the producing thread
+     *
+     * @return false if the ring is full
+     */
+    bool push(const T &item) {
+      std::size_t tail = _tail.load(std::memory_order_relaxed), next = tail + 1 == _slots.size() ? 0 : tail + 1;
+      if( next == _head.load(std::memory_order_acquire) ) return false;
+      _slots[tail] = item;
+      _tail.store(next, std::memory_order_release);
+      return true;
+    }
+
+    /**
+     * take the oldest item, from the consuming thread
+     *
+     * @return false if the ring is empty
+     */
+    bool pop(T &item) {
+      std::size_t head = _head.load(std::memory_order_relaxed);
+      if( head == _tail.load(std::memory_order_acquire) ) return false;
+      item = _slots[head];
+      _head.store(head + 1 == _slots.size() ? 0 : head + 1, std::memory_order_release);
+      return true;
+    }
+  };
+
+  /**
+   * A source which reads straight into an InputPipeline's buffers, with several reads in flight at once (see
+   * UringSource).  The pipeline's reader thread makes all the calls.
+   */
+  class AsyncSource {
+  public:
+    virtual ~AsyncSource() {}
+
+    /**
+     * the pipeline's buffers, given once before any read
+     *
+     * @param buffers count buffers of size characters each, aligned to a page
+     */
+    virtual void attach(char *const *buffers, std::size_t count, std::size_t size) = 0;
+
+    /**
+     * start reading the next size characters of the input into buffer index; or, with from, carry on a read into it
+     * which came back short, filling the buffer from character from with what follows in the input
+     */
+    virtual void submit(std::size_t index, std::size_t from = 0) = 0;
+
+    /**
+     * wait for a read to finish, in any order
+     *
+     * @param result the characters read, which may be fewer than asked for (0 only at the end of the input), or -errno
+     * @return the index of its buffer
+     */
+    virtual std::size_t complete(std::ptrdiff_t &result) = 0;
+  };
+
+  /**
+   * Reads its source on a thread of its own, into depth buffers of chunk_size characters, each aligned to a page.  The
+   * buffers go round two SpscRings: the reader fills free buffers and queues them, the parsing thread takes them in
+   * order (acquire) and gives them back (release).  The parsing thread can hold several spans into a buffer, counting
+   * them with retain; a buffer is only refilled once every one has been released.
+   *
+   * Waiting on an empty or full ring spins (yielding) briefly, then sleeps in short steps; the rings themselves are
+   * lock-free.  With an AsyncSource, every free buffer has a read in flight, and the reader waits on the source rather
+   * than the ring while any does.
+   */
+  class InputPipeline {
+  public:
+    /**
+     * reads up to size characters into data
+     *
+     * @return the number read; 0 only at the end of the input
+     */
+    typedef std::function<std::size_t (char *data, std::size_t size)> Source;
+
+    /**
+     * a buffer of input, in the order read
+     */
+    class Chunk {
+      friend class InputPipeline;
+      char *_data;
+      std::size_t _size;	/**< characters read into it */
+      std::size_t _refs;	/**< spans the parsing thread holds */
+    public:
+      const char* data() const { return _data; }
+      std::size_t size() const { return _size; }
+    };
+  private:
+    static const std::size_t end_of_input = std::size_t(-1); /**< queued after the last chunk */
+    static const std::size_t alignment = 4096;
+
+    Source _source;
+    AsyncSource *_async;	/**< reads instead of _source, if set */
+    std::size_t _chunk_size;
+    std::vector<Chunk> _chunks;
+    SpscRing<std::size_t> _full	/**< chunks read, for the parsing thread */
+      , _free;			/**< chunks released, for the reader */
+    std::atomic<bool> _stop;
+    std::exception_ptr _error;	/**< thrown by the source; rethrown by acquire at the end */
+    bool _ended;		/**< acquire has seen the end of the input */
+    std::uint64_t _offset;	/**< see offset */
+    std::thread _reader;
+
+    /* wait a moment before trying a ring again; tries counts the attempts so far */
+    static void backoff(std::size_t &tries) {
+      if(++tries < 1000) std::this_thread::yield();
+      else std::this_thread::sleep_for( std::chrono::microseconds(50) );
+    }
+
+    void read() {
+      try {
+	for(;;) {
+	  std::size_t index, tries = 0;
+	  while( !_free.pop(index) ) {
+	    if(_stop) return;
+	    backoff(tries);
+	  }
+
+	  /* fill the chunk, unless the input ends first */
+	  Chunk &chunk = _chunks[index];
+	  chunk._size = 0;
+	  std::size_t n;
+	  while( chunk._size < _chunk_size && (n = _source(chunk._data + chunk._size, _chunk_size - chunk._size)) )
+	    chunk._size += n;
+
+	  if(chunk._size) queue(index);
+	  if(chunk._size < _chunk_size) break;
+	}
+      } catch(...) {
+	_error = std::current_exception();
+      }
+      queue(end_of_input);
+    }
+
+    /* read with _async: keep a read in flight in every free buffer, and queue them in the order submitted */
+    void read_async() {
+      std::deque<std::size_t> submitted;	/* buffers with a read in flight, oldest first */
+      std::vector<std::ptrdiff_t> finished(_chunks.size(), -1); /* result of each buffer's read, once in */
+      std::vector<std::size_t> filled(_chunks.size(), 0);	/* characters read into each buffer so far */
+      std::vector<bool> waiting(_chunks.size(), false);
+      bool ended = false;
+
+      for(;;) {
+	std::size_t index, tries = 0;
+	while( !ended && !_stop && _free.pop(index) ) {
+	  _async->submit(index);
+	  filled[index] = 0;
+	  submitted.push_back(index);
+	  waiting[index] = true;
+	}
+	if( submitted.empty() ) {
+	  if(ended || _stop) break;
+	  backoff(tries);	/* the parsing thread holds every buffer */
+	  continue;
+	}
+
+	/* wait for the oldest, keeping the others' results */
+	index = submitted.front();
+	submitted.pop_front();
+	while(waiting[index]) {
+	  std::ptrdiff_t result;
+	  std::size_t done = _async->complete(result);
+	  waiting[done] = false;
+	  finished[done] = result;
+	}
+	std::ptrdiff_t result = finished[index];
+	if(ended || _stop) continue;	/* read past the end, or no longer wanted */
+	if(result < 0) {
+	  _error = std::make_exception_ptr( std::runtime_error( std::string("InputPipeline: read failed: ")
+								 + std::strerror(-result) ) );
+	  ended = true;
+	  continue;
+	}
+	filled[index] += result;
+	if(result && filled[index] < _chunk_size) {
+	  /* a short read isn't the end until one reads nothing, as with _source */
+	  _async->submit(index, filled[index]);
+	  submitted.push_front(index);
+	  waiting[index] = true;
+	  continue;
+	}
+	_chunks[index]._size = filled[index];
+	if(filled[index]) queue(index);
+	if(filled[index] < _chunk_size) ended = true;
+      }
+      queue(end_of_input);
+    }
+
+    void queue(std::size_t index) {
+      std::size_t tries = 0;
+      while( !_full.push(index) ) {
+	if(_stop) return;
+	backoff(tries);
+      }
+    }
+
+    void start(std::size_t depth) {
+      _chunks.resize(depth ? depth : 1);
+      for(std::size_t i = 0; i < _chunks.size(); ++i) {
+	void *data = nullptr;
+	if( posix_memalign(&data, alignment, _chunk_size) ) {
+	  for(std::size_t j = 0; j < i; ++j) std::free(_chunks[j]._data);
+	  throw std::bad_alloc();
+	}
+	_chunks[i]._data = static_cast<char*>(data);
+	_chunks[i]._size = _chunks[i]._refs = 0;
+	_free.push(i);
+      }
+      if(_async) {
+	std::vector<char*> buffers;
+	for(auto &chunk : _chunks) buffers.push_back(chunk._data);
+	try {
+	  _async->attach(buffers.data(), buffers.size(), _chunk_size);
+	} catch(...) {
+	  for(auto &chunk : _chunks) std::free(chunk._data);
+	  throw;
+	}
+      }
+      _reader = std::thread(_async ? &InputPipeline::read_async : &InputPipeline::read, this);
+    }
+  public:
+    /**
+     * start reading source
+     *
+     * @param chunk_size characters in each buffer
+     * @param depth number of buffers (how far the reader may get ahead)
+     */
+    InputPipeline(const Source &source, std::size_t chunk_size = 1 << 20, std::size_t depth = 4)
+      : _source(source), _async(nullptr), _chunk_size(chunk_size ? chunk_size : 1), _full(depth ? depth + 1 : 2)
+      , _free(depth ? depth : 1), _stop(false), _ended(false), _offset(0) {
+      start(depth);
+    }
+
+    /**
+     * start reading source, which has to outlive the pipeline; it gets depth reads in flight
+     */
+    InputPipeline(AsyncSource &source, std::size_t chunk_size = 1 << 20, std::size_t depth = 4)
+      : _async(&source), _chunk_size(chunk_size ? chunk_size : 1), _full(depth ? depth + 1 : 2)
+      , _free(depth ? depth : 1), _stop(false), _ended(false), _offset(0) {
+      start(depth);
+    }
+
+    /**
+     * start reading in from where it is; in has to outlive the pipeline, and not be used by anyone else meanwhile
+     */
+    InputPipeline(std::istream &in, std::size_t chunk_size = 1 << 20, std::size_t depth = 4)
+      : InputPipeline( [&in](char *data, std::size_t size) -> std::size_t {
+	  in.read(data, size);
+	  return in.gcount();
+	}, chunk_size, depth ) {}
+
+    InputPipeline(const InputPipeline&) = delete;
+
+    ~InputPipeline() {
+      _stop = true;
+      _reader.join();
+      for(auto &chunk : _chunks) std::free(chunk._data);
+    }
+
+    /** @return characters in each buffer */
+    std::size_t chunk_size() const { return _chunk_size; }
+
+    /** @return number of buffers */
+    std::size_t depth() const { return _chunks.size(); }
+
+    /**
+     * the next chunk of input, holding one reference to it (see release); waits for the reader if need be
+     *
+     * @return the chunk, or nullptr at the end of the input
+     * @throw whatever the source threw, once the chunks read before it have been taken
+     */
+    Chunk* acquire() {
+      if(_ended) return nullptr;
+      std::size_t index, tries = 0;
+      while( !_full.pop(index) ) backoff(tries);
+
+      if(index == end_of_input) {
+	_ended = true;
+	if(_error) std::rethrow_exception(_error);
+	return nullptr;
+      }
+      _chunks[index]._refs = 1;
+      return &_chunks[index];
+    }
+
+    /**
+     * hold another span into chunk (each needs a release)
+     */
+    void retain(Chunk *chunk) { ++chunk->_refs; }
+
+    /**
+     * drop a span into chunk; after the last, the reader may fill it again
+     */
+    void release(Chunk *chunk) {
+      if( --chunk->_refs == 0 ) _free.push(chunk - _chunks.data());
+    }
+
+    /**
+     * @return characters of the input foreach_line has handed out (lines and their newlines), so where the next line
+     * starts, counting from where reading started
+     */
+    std::uint64_t offset() const { return _offset; }
+
+    /**
+     * apply handle_line to each line of the input, without its newline, like foreach_line (so the text after the last
+     * newline is a line too, even if it's empty).  A line is copied once, from the buffer into the string handed to
+     * handle_line (which it may change, as a Parser does); one split between buffers is put together there.
+     *
+     * @param handle_line called with a std::string&
+     */
+    template<class LineHandler>
+    void foreach_line(LineHandler &&handle_line) {
+      std::string line;
+      bool carried = false;	/* line holds the start of a line from the chunk before */
+      while(Chunk *chunk = acquire()) {
+	const char *p = chunk->data(), *end = p + chunk->size();
+	try {
+	  while(p < end) {
+	    const char *newline = static_cast<const char*>( std::memchr(p, '\n', end - p) );
+	    if(!newline) {
+	      if(carried) line.append(p, end);
+	      else line.assign(p, end);
+	      carried = true;
+	      break;
+	    }
+
+	    if(carried) line.append(p, newline);
+	    else line.assign(p, newline);
+	    carried = false;
+	    _offset += line.size() + 1;
+	    p = newline + 1;
+	    handle_line(line);
+	  }
+	} catch(...) {
+	  release(chunk);
+	  throw;
+	}
+	release(chunk);
+      }
+      if(!carried) line.clear();
+      _offset += line.size();
+      handle_line(line);
+    }
+  };
+}
+
+#endif
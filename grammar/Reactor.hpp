@@ -0,0 +1,244 @@
+#ifndef GRAMMAR_REACTOR_HPP
+#define GRAMMAR_REACTOR_HPP
+/**
+ * @file grammar/Reactor.hpp
+ *
+ * Runs many streams (sockets, pipes), each with its own Parser on one shared grammar, from a single thread with epoll.
+ * Linux only.
+ */
+
+#ifdef __linux__
+
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "./Parser.hpp"
+
+namespace grammar {
+  /**
+   * Owns a set of non-blocking descriptors and a Parser for each, all following the same GrammarSlot.  Each time a
+   * stream is ready it gets a turn: one read of at most a chunk into its buffer, then its parser runs until it wants
+   * more input or has applied its share of rules.  A stream with work left over goes to the back of the queue, so a
+   * busy stream can't starve the others.  Reads are parsed with Parser::push, so a token cut between two reads (by the
+   * sender, or by TCP) is only taken once the rest of it has come, or the stream has ended.
+   *
+   * Buffers are bounded: while a stream's buffer is full it isn't read, and if its parser is still waiting for more
+   * of the input than fits, the stream is dropped with an error.  The parsers' actions can find out which stream they
+   * are working for with current().
+   */
+  class Reactor {
+  public:
+    typedef std::size_t StreamId;
+    static const StreamId no_stream = StreamId(-1);
+  private:
+    class Stream {
+    public:
+      int fd;
+      Parser parse;
+      std::string buffer;	/**< unparsed input */
+      bool queued;		/**< in _runnable */
+    };
+
+    GrammarSlot &_grammar;
+    int _epoll;
+    std::vector<std::unique_ptr<Stream> > _streams; /**< by id; empty entries have been removed */
+    std::vector<StreamId> _free;		     /**< ids to reuse */
+    std::deque<StreamId> _runnable;		     /**< streams waiting for a turn */
+    std::size_t _count				     /**< streams open */
+      , _chunk					     /**< most characters read in a turn */
+      , _max_buffer				     /**< most characters held for a stream */
+      , _turn_steps;				     /**< most rules applied in a turn */
+    StreamId _current;
+    std::function<void (StreamId)> _on_close;
+    std::function<void (StreamId, const std::exception&)> _on_error;
+
+    static std::runtime_error system_error(const char *what) {
+      return std::runtime_error( std::string("Reactor: ").append(what).append(": ").append( std::strerror(errno) ) );
+    }
+
+    void queue(StreamId id) {
+      Stream &s = *_streams[id];
+      if(s.queued) return;
+      s.queued = true;
+      _runnable.push_back(id);
+    }
+
+    /* read once and parse; true if the stream has work left for another turn */
+    bool turn(StreamId id) {
+      Stream &s = *_streams[id];
+      bool eof = false;
+
+      if(s.buffer.size() < _max_buffer) {
+	std::size_t old = s.buffer.size()
+	  , room = std::min(_chunk, _max_buffer - old);
+	s.buffer.resize(old + room);
+	ssize_t n;
+	do n = ::read(s.fd, &s.buffer[old], room); while(n < 0 && errno == EINTR);
+	s.buffer.resize(old + (n > 0 ? n : 0));
+
+	if(n == 0) eof = true;
+	else if(n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+	  drop(id, system_error("read"));
+	  return false;
+	}
+      }
+
+      ParseStatus status;
+      _current = id;
+      try {
+	status = s.parse.push(s.buffer, Budget().steps(_turn_steps), !eof);
+      } catch(std::exception &e) {
+	_current = no_stream;
+	drop(id, e);
+	return false;
+      }
+      _current = no_stream;
+
+      if(status == ParseStatus::exhausted) return true;
+      if(eof) {
+	remove(id);
+	return false;
+      }
+      if(s.buffer.size() >= _max_buffer) {
+	drop(id, std::runtime_error("Reactor: stream buffer is full and the parser is still waiting for more input"));
+	return false;
+      }
+      return false;
+    }
+
+    void drop(StreamId id, const std::exception &e) {
+      if(_on_error) _on_error(id, e);
+      remove(id);
+    }
+  public:
+    /**
+     * @param grammar every stream's parser follows this slot (see Parser::attach)
+     * @param max_buffer most characters held for one stream
+     * @param chunk most characters read from a stream in one turn
+     * @param turn_steps most rules applied for one stream in one turn
+     */
+    Reactor(GrammarSlot &grammar, std::size_t max_buffer = 1 << 16, std::size_t chunk = 4096
+	    , std::size_t turn_steps = 4096)
+      : _grammar(grammar), _epoll( epoll_create1(0) ), _count(0), _chunk(chunk), _max_buffer(max_buffer)
+      , _turn_steps(turn_steps), _current(no_stream) {
+      if(_epoll < 0) throw system_error("epoll_create1");
+    }
+
+    Reactor(const Reactor&) = delete;
+
+    /**
+     * closes the streams still open (without calling on_close)
+     */
+    ~Reactor() {
+      for(auto &s : _streams) if(s) ::close(s->fd);
+      ::close(_epoll);
+    }
+
+    /**
+     * take a descriptor (which is made non-blocking, and closed when the stream is removed)
+     *
+     * @return the id of the stream
+     */
+    StreamId add(int fd) {
+      StreamId id;
+      if(_free.empty()) {
+	id = _streams.size();
+	_streams.push_back( std::unique_ptr<Stream>() );
+      }
+      else {
+	id = _free.back();
+	_free.pop_back();
+      }
+
+      std::unique_ptr<Stream> s(new Stream);
+      s->fd = fd;
+      s->queued = false;
+      s->parse.attach(_grammar);
+
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+      epoll_event ev;
+      ev.events = EPOLLIN;
+      ev.data.u64 = id;
+      if( epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &ev) < 0 ) {
+	_free.push_back(id);
+	throw system_error("epoll_ctl");
+      }
+
+      _streams[id] = std::move(s);
+      ++_count;
+      return id;
+    }
+
+    /**
+     * close a stream and forget it (calls on_close).  Not from the stream's own parser actions.
+     */
+    void remove(StreamId id) {
+      if(id >= _streams.size() || !_streams[id]) return;
+      epoll_ctl(_epoll, EPOLL_CTL_DEL, _streams[id]->fd, nullptr);
+      ::close(_streams[id]->fd);
+      _streams[id].reset();
+      _free.push_back(id);
+      --_count;
+      if(_on_close) _on_close(id);
+    }
+
+    /** called with the id of each stream as it is removed (at the end of its input, or by remove) */
+    void on_close(const std::function<void (StreamId)> &fn) { _on_close = fn; }
+
+    /** called with the id of a stream and the reason before it is dropped for an error (which the parser threw, say) */
+    void on_error(const std::function<void (StreamId, const std::exception&)> &fn) { _on_error = fn; }
+
+    /** @return the stream being parsed (for the parsers' actions), or no_stream */
+    StreamId current() const { return _current; }
+
+    /** @return the number of streams open */
+    std::size_t size() const { return _count; }
+
+    /**
+     * wait for ready streams, then give each waiting stream one turn
+     *
+     * @param timeout_ms as for epoll_wait; streams with work left over don't wait
+     * @return the number of turns taken
+     */
+    std::size_t run_once(int timeout_ms = -1) {
+      epoll_event events[256];
+      int n = epoll_wait(_epoll, events, 256, _runnable.empty() ? timeout_ms : 0);
+      if(n < 0 && errno != EINTR) throw system_error("epoll_wait");
+
+      for(int i = 0; i < n; ++i) {
+	StreamId id = events[i].data.u64;
+	if(id < _streams.size() && _streams[id]) queue(id);
+      }
+
+      /* just the streams queued so far; those which go back in the queue wait for the next round */
+      std::size_t turns = _runnable.size();
+      for(std::size_t i = 0; i < turns; ++i) {
+	StreamId id = _runnable.front();
+	_runnable.pop_front();
+	if(id >= _streams.size() || !_streams[id]) continue;
+
+	_streams[id]->queued = false;
+	if( turn(id) ) queue(id);
+      }
+      return turns;
+    }
+
+    /**
+     * run until every stream has been removed
+     */
+    void run() { while(_count) run_once(); }
+  };
+}
+
+#endif
+#endif
@@ -6,10 +6,10 @@
  *  Created on Sunday 30 2012  
  */
 #include "./Rule.hpp"
-/* #include "./ReduceAction.hpp" */
+#include "./Action.hpp"
 
 #include <iostream>
-#include <functional>
+#include <sstream>
 #include <string>
 
 namespace grammar {
@@ -18,7 +18,7 @@ namespace grammar {
    */
   class Reduce : public Rule {
   public:
-    typedef std::function<void (Match&) > ActionType;
+    typedef Action<void (Match&) > ActionType;
   protected:
     Rule* default_;		/**< following rule */
     ActionType action_;	/**< action to take on scanned string (does not specify follow up Rule)*/
@@ -28,7 +28,6 @@ namespace grammar {
      */
     Reduce() {
       default_ = NULL;
-      action_ = NULL;
     }
   
     /**
@@ -82,6 +81,17 @@ namespace grammar {
       action_ = r;
     }
 
+    /**
+     * @return the capture of the scanned Match the action is about (0, the whole match, unless it takes just one)
+     */
+    virtual int capture() const { return 0; }
+
+    /** how much of the scanned Match the action looks at */
+    enum Uses { all_captures, one_capture /**< just capture() */, no_captures };
+
+    /** @return how much of the scanned Match the action looks at (so less has to be kept when it's put off) */
+    virtual Uses uses() const { return all_captures; }
+
     /**
      * applies the action_ to the scanned string
      * 
@@ -95,6 +105,67 @@ namespace grammar {
       return get_default();
     }
   };
+
+  /**
+   * Reduce with the callable's type known, so the Parser's virtual call into the rule is the only indirection.
+   * Calls hook with the scanned Match.
+   *
+   * @tparam F type of the hook
+   */
+  template<class F>
+  class ReduceWith : public Reduce {
+    F _hook;
+  public:
+    ReduceWith(F hook) : _hook(std::move(hook)) {}
+
+    Rule* operator()(Match &scanned, std::string &input, bool &more_chars) {
+      _hook( scanned );
+      more_chars = false;
+      return get_default();
+    }
+  };
+
+  /**
+   * Reduce which calls hook with one capture of the scanned Match (see DefineGrammar::on_string).
+   *
+   * @tparam F type of the hook
+   */
+  template<class F>
+  class ReduceString : public Reduce {
+    F _hook;
+    int _index;			/**< capture to pass to hook */
+  public:
+    ReduceString(F hook, int index) : _hook(std::move(hook)), _index(index) {}
+
+    int capture() const { return _index; }
+    Uses uses() const { return one_capture; }
+
+    Rule* operator()(Match &scanned, std::string &input, bool &more_chars) {
+      _hook( scanned.scratch(_index) );
+      more_chars = false;
+      return get_default();
+    }
+  };
+
+  /**
+   * Reduce which calls hook without arguments (see DefineGrammar::thunk).
+   *
+   * @tparam F type of the hook
+   */
+  template<class F>
+  class ReduceThunk : public Reduce {
+    F _hook;
+  public:
+    ReduceThunk(F hook) : _hook(std::move(hook)) {}
+
+    Uses uses() const { return no_captures; }
+
+    Rule* operator()(Match &scanned, std::string &input, bool &more_chars) {
+      _hook();
+      more_chars = false;
+      return get_default();
+    }
+  };
 }
 
 #endif
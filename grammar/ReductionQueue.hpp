@@ -0,0 +1,126 @@
+#ifndef GRAMMAR_REDUCTIONQUEUE_HPP
+#define GRAMMAR_REDUCTIONQUEUE_HPP
+/**
+ * @file grammar/ReductionQueue.hpp
+ *
+ * Reductions put off until later: what a Parser keeps when it batches its reductions (see Parser::batch_reductions).
+ */
+
+#include <string>
+#include <vector>
+
+#include "./Match.hpp"
+#include "./Reduce.hpp"
+
+namespace grammar {
+  /**
+   * Reductions waiting to be applied, in order, with the captures they use.  The inputs of the calls they were made in
+   * are kept end to end, and captures are held as spans of that; a reduction whose match isn't on the current call's
+   * input (the scan was in an earlier call, or input was put back since) keeps a copy of its Match instead.
+   */
+  class ReductionQueue {
+    class Queued {
+    public:
+      Reduce *reduce;
+      std::size_t first, count;	/**< its captures in _spans */
+      std::size_t copy;		/**< its Match in _copies, or -1 */
+    };
+
+    Match _text;		/**< the inputs of the calls, end to end */
+    std::size_t _call;		/**< where the current call's input starts in _text */
+    std::vector<Queued> _queued;
+    std::vector<Match::Span> _spans;
+    std::vector<Match> _copies;
+  public:
+    ReductionQueue() : _call(0) {}
+
+    /**
+     * drop the queued reductions without applying them
+     */
+    void clear() {
+      _queued.clear();
+      _spans.clear();
+      _copies.clear();
+    }
+
+    /** @return true if nothing is queued */
+    bool empty() const { return _queued.empty(); }
+
+    /** @return the number of reductions queued */
+    std::size_t size() const { return _queued.size(); }
+
+    /**
+     * a call of the Parser begins: keep its input, which the captures of its reductions will be spans of
+     */
+    void begin_call(const std::string &input) {
+      if( _queued.empty() ) {
+	_text.set_input(input);
+	_call = 0;
+      }
+      else {
+	_call = _text.input().size();
+	_text.append_input(input);
+      }
+    }
+
+    /**
+     * queue reduce, keeping the captures of scanned it uses
+     *
+     * @param consumed how much of the call's input had been consumed when reduce was reached
+     */
+    void push(Reduce *reduce, const Match &scanned, std::size_t consumed) {
+      Queued q;
+      q.reduce = reduce;
+      q.first = _spans.size();
+      q.count = 0;
+      q.copy = std::size_t(-1);
+
+      Reduce::Uses uses = reduce->uses();
+      if(uses != Reduce::no_captures) {
+	std::ptrdiff_t base = std::ptrdiff_t(consumed)
+	  - (scanned.matched(0) ? scanned.position(0) + scanned.length(0) : 0);
+	if( base < 0 || _call + base + scanned.input().size() != _text.input().size() ) {
+	  q.copy = _copies.size();
+	  _copies.push_back(scanned);
+	  _queued.push_back(q);
+	  return;
+	}
+	base += _call;
+
+	/* captures the action doesn't look at are left unmatched */
+	std::size_t only = uses == Reduce::one_capture ? reduce->capture() : std::size_t(-1);
+	q.count = uses == Reduce::one_capture ? only + 1 : scanned.size();
+	for(std::size_t i = 0; i < q.count; ++i)
+	  _spans.push_back( (only == std::size_t(-1) || i == only) && scanned.matched(i)
+			    ? Match::Span(base + scanned.position(i), scanned.length(i))
+			    : Match::Span(-1, 0) );
+      }
+      _queued.push_back(q);
+    }
+
+    /**
+     * apply the queued reductions in order, and empty the queue (even if one throws)
+     */
+    void apply() {
+      std::string input;
+      bool more = false;
+      try {
+	for(std::size_t i = 0; i < _queued.size(); ++i) {
+	  const Queued &q = _queued[i];
+	  if(q.copy != std::size_t(-1)) {
+	    (*q.reduce)(_copies[q.copy], input, more);
+	    continue;
+	  }
+	  _text.set_spans( _spans.begin() + q.first, _spans.begin() + q.first + q.count );
+	  (*q.reduce)(_text, input, more);
+	}
+      } catch(...) {
+	clear();
+	throw;
+      }
+      clear();
+    }
+  };
+}
+
+#endif
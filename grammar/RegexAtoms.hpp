@@ -0,0 +1,273 @@
+#ifndef GRAMMAR_REGEXATOMS_HPP
+#define GRAMMAR_REGEXATOMS_HPP
+/**
+ * @file grammar/RegexAtoms.hpp
+ *
+ * A (very) small reader for the leading part of a regular expression.  It only understands anchored runs of literal
+ * characters, the \s \d \w classes and bracket expressions, optionally repeated with * or +; everything else ends the
+ * run.  That is enough for
+ * the grammar passes which want to reason about patterns without running them (see Branch::factor_prefixes).
+ */
+
+#include <bitset>
+#include <cctype>
+#include <string>
+#include <vector>
+
+namespace grammar {
+  /**
+   * the leading atoms of an anchored regular expression.
+   */
+  class RegexAtoms {
+  public:
+    typedef std::bitset<256> CharSet;
+
+    /**
+     * one literal character or class, with its repetition
+     */
+    class Atom {
+    public:
+      std::string text;		/**< source text of the atom, including any quantifier */
+      CharSet set;		/**< characters the atom matches */
+      char quantifier;		/**< '*', '+' or 0 for exactly once */
+      std::size_t end;		/**< index in the source just past this atom */
+
+      bool operator==(const Atom &a) const { return text == a.text; }
+    };
+
+  private:
+    std::string _source;
+    std::vector<Atom> _atoms;
+    bool _anchored;		/**< the pattern is anchored to the start of its input */
+
+    static CharSet class_set(char c) {
+      CharSet set;
+      for(int i = 0; i < 256; ++i) {
+	bool in;
+	switch( std::tolower(c) ) {
+	case 's': in = std::isspace(i); break;
+	case 'd': in = std::isdigit(i); break;
+	default:  in = std::isalnum(i) || i == '_'; break;
+	}
+	set[i] = std::isupper(c) ? !in : in;
+      }
+      return set;
+    }
+
+    /* set of a [:name:] class inside a bracket expression; false if the name isn't known */
+    static bool named_set(const std::string &name, CharSet &set) {
+      for(int i = 0; i < 256; ++i) {
+	bool in;
+	if(name == "alpha") in = std::isalpha(i);
+	else if(name == "digit") in = std::isdigit(i);
+	else if(name == "alnum") in = std::isalnum(i);
+	else if(name == "space") in = std::isspace(i);
+	else if(name == "upper") in = std::isupper(i);
+	else if(name == "lower") in = std::islower(i);
+	else if(name == "punct") in = std::ispunct(i);
+	else if(name == "xdigit") in = std::isxdigit(i);
+	else if(name == "blank") in = i == ' ' || i == '\t';
+	else if(name == "cntrl") in = std::iscntrl(i);
+	else if(name == "print") in = std::isprint(i);
+	else if(name == "graph") in = std::isgraph(i);
+	else return false;
+	if(in) set[i] = true;
+      }
+      return true;
+    }
+
+    /* read the bracket expression starting at _source[i] into set; returns the index past it, or 0 if it isn't one I
+       understand */
+    std::size_t read_bracket(std::size_t i, CharSet &set) const {
+      bool negate = false;
+      ++i;
+      if(i < _source.size() && _source[i] == '^') {
+	negate = true;
+	++i;
+      }
+
+      for(bool first = true; i < _source.size(); first = false) {
+	unsigned char c = _source[i];
+
+	if(c == ']' && !first) {
+	  if(negate) set.flip();
+	  return i + 1;
+	}
+
+	if(c == '[') {
+	  if(i + 1 >= _source.size() || _source[i + 1] != ':') return 0; /* collating elements */
+	  std::size_t close = _source.find(":]", i + 2);
+	  if(close == std::string::npos || !named_set(_source.substr(i + 2, close - i - 2), set)) return 0;
+	  i = close + 2;
+	  continue;
+	}
+
+	if(c == '\\') {
+	  if(i + 1 >= _source.size()) return 0;
+	  unsigned char n = _source[i + 1];
+	  if( std::string("sSdDwW").find(n) != std::string::npos ) {
+	    set |= class_set(n);
+	    i += 2;
+	    continue;
+	  }
+	  if( std::isalnum(n) ) return 0;
+	  c = n;
+	  ++i;
+	}
+
+	/* a range */
+	if(i + 2 < _source.size() && _source[i + 1] == '-' && _source[i + 2] != ']') {
+	  unsigned char last = _source[i + 2];
+	  if(last == '\\' || last == '[' || last < c) return 0;
+	  for(int k = c; k <= last; ++k) set[k] = true;
+	  i += 3;
+	  continue;
+	}
+
+	set[c] = true;
+	++i;
+      }
+      return 0;
+    }
+
+    /* true if c is a top level | (which would make the whole pattern an alternation) */
+    static bool has_alternation(const std::string &s) {
+      bool in_class = false;
+      for(std::size_t i = 0; i < s.size(); ++i) {
+	if(s[i] == '\\') ++i;
+	else if(in_class) { if(s[i] == ']') in_class = false; }
+	else if(s[i] == '[') in_class = true;
+	else if(s[i] == '|') return true;
+      }
+      return false;
+    }
+
+    void read(std::size_t i) {
+      while(i < _source.size()) {
+	Atom a;
+	std::size_t start = i;
+	char c = _source[i];
+
+	if(c == '\\') {
+	  if(i + 1 >= _source.size()) return;
+	  char n = _source[i + 1];
+	  if( std::string("sSdDwW").find(n) != std::string::npos )
+	    a.set = class_set(n);
+	  else if( !std::isalnum(static_cast<unsigned char>(n)) && std::string("<>`'").find(n) == std::string::npos )
+	    a.set[static_cast<unsigned char>(n)] = true;
+	  else
+	    return;			/* \b, \1, \n, \< ... */
+	  i += 2;
+	}
+	else if(c == '[') {
+	  i = read_bracket(i, a.set);
+	  if(i == 0) return;
+	}
+	else if( std::string("()[]{}|.$^?*+").find(c) != std::string::npos )
+	  return;
+	else {
+	  a.set[static_cast<unsigned char>(c)] = true;
+	  ++i;
+	}
+
+	a.quantifier = 0;
+	if(i < _source.size()) {
+	  char q = _source[i];
+	  if(q == '?' || q == '{') return; /* optional atoms aren't worth the trouble */
+	  if(q == '*' || q == '+') {
+	    /* lazy and possessive repeats end the run */
+	    if(i + 1 < _source.size() && (_source[i + 1] == '?' || _source[i + 1] == '+')) return;
+	    a.quantifier = q;
+	    ++i;
+	  }
+	}
+
+	a.text = _source.substr(start, i - start);
+	a.end = i;
+	_atoms.push_back(a);
+      }
+    }
+  public:
+    /**
+     * read the leading atoms of source.
+     *
+     * @param source the regular expression
+     * @param implicit_anchor treat the pattern as anchored even without a leading ^ (it will only be tried at a fixed
+     *   offset)
+     */
+    RegexAtoms(const std::string &source, bool implicit_anchor = false) : _source(source), _anchored(false) {
+      if( has_alternation(source) ) return;
+
+      if(!source.empty() && source[0] == '^') {
+	_anchored = true;
+	read(1);
+      }
+      else if(implicit_anchor) {
+	_anchored = true;
+	read(0);
+      }
+    }
+
+    /** true if the pattern can only match at the start of its input */
+    bool anchoredP() const { return _anchored; }
+
+    std::size_t size() const { return _atoms.size(); }
+    const Atom& operator[](std::size_t i) const { return _atoms[i]; }
+    const std::string& source() const { return _source; }
+
+    /**
+     * number of leading atoms this and other share
+     */
+    std::size_t common(const RegexAtoms &other) const {
+      std::size_t n = 0;
+      while(n < size() && n < other.size() && _atoms[n] == other._atoms[n]) ++n;
+      return n;
+    }
+
+    /**
+     * the longest prefix of at most n atoms which can only match one way (so a pattern can be split after it without
+     * changing what the rest matches).  A repeated atom must be followed by a single atom it can't match, and the
+     * prefix can't end on a repeat.
+     *
+     * @return number of atoms in the prefix
+     */
+    std::size_t deterministic_prefix(std::size_t n) const {
+      if(n > size()) n = size();
+      while(n > 0) {
+	bool ok = _atoms[n - 1].quantifier == 0;
+	for(std::size_t i = 0; ok && i + 1 < n; ++i)
+	  if(_atoms[i].quantifier)
+	    ok = _atoms[i + 1].quantifier == 0 && (_atoms[i].set & _atoms[i + 1].set).none();
+	if(ok) return n;
+	--n;
+      }
+      return 0;
+    }
+
+    /**
+     * the bytes a match can begin with.  Only known when some atom has to match at least once (every atom before it
+     * being a *).
+     *
+     * @param set receives the bytes
+     * @return true if set is exact
+     */
+    bool first_bytes(CharSet &set) const {
+      set.reset();
+      for(auto &a : _atoms) {
+	set |= a.set;
+	if(a.quantifier != '*') return true;
+      }
+      return false;
+    }
+
+    /**
+     * index in the source just past the first n atoms
+     */
+    std::size_t split_point(std::size_t n) const {
+      if(n == 0) return (_anchored && !_source.empty() && _source[0] == '^') ? 1 : 0;
+      return _atoms[n - 1].end;
+    }
+  };
+}
+
+#endif
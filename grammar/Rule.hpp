@@ -7,8 +7,10 @@
  */
 
 #include <string>
-#include <set>
+#include <unordered_set>
+#include <vector>
 #include <ostream>
+#include <functional>
 
 #include "./Match.hpp"
 
@@ -60,11 +62,30 @@ namespace grammar {
     virtual Rule* operator()(Match &scanned, std::string &input, bool &more_input_required)=0;
 
     virtual void print(PrintRecursiveRule &out_);
+
+    /**
+     * apply fn to every Rule this one may pass control to.  Rules which can go more than one way (Branch, If) override
+     * this; it's what lets a pass walk the whole grammar.
+     *
+     * @param fn called once for each following Rule
+     */
+    virtual void for_successors(const std::function<void (Rule*)> &fn) {
+      if( get_default() ) fn( get_default() );
+    }
+
+    /**
+     * add this Rule, the first of a case in the grammar definition, to branch as a case.  Only the scanners (Until,
+     * Otherwise and Branch) can begin a case.
+     *
+     * @param branch the Branch being built
+     * @return false if this kind of Rule can't begin a case
+     */
+    virtual bool add_as_case(Branch *branch) { return false; }
   };
 
   /* Checks to see if I've visited rule while printing */
   class DetectCycle {
-    std::set<Rule*> seen_;
+    std::unordered_set<Rule*> seen_;
   public:
     /**
      * default constructor.
@@ -76,11 +97,36 @@ namespace grammar {
      * return false
      */
     bool seen_beforeP(Rule *r) {
-      if( seen_.find(r) == seen_.end() ) {
-	seen_.insert(r);
-	return false;
+      return !seen_.insert(r).second;
+    }
+  };
+
+  /**
+   * Visits every Rule reachable from a starting point exactly once (the grammars may contain cycles).
+   */
+  class WalkRules : public DetectCycle {
+  public:
+    /**
+     * apply fn to start and each rule reachable from it, in depth first order.
+     *
+     * @param start first rule to visit
+     * @param fn called once for each rule
+     */
+    void walk(Rule *start, const std::function<void (Rule*)> &fn) {
+      std::vector<Rule*> pending;
+      if(start) pending.push_back(start);
+
+      while(!pending.empty()) {
+	Rule *r = pending.back();
+	pending.pop_back();
+	if( seen_beforeP(r) ) continue;
+
+	fn(r);
+	/* push in reverse so the first successor is visited first */
+	std::vector<Rule*> next;
+	r->for_successors( [&](Rule *s) { next.push_back(s); } );
+	pending.insert(pending.end(), next.rbegin(), next.rend());
       }
-      return true;
     }
   };
 
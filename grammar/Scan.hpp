@@ -0,0 +1,199 @@
+#ifndef GRAMMAR_SCAN_HPP
+#define GRAMMAR_SCAN_HPP
+/**
+ * @file grammar/Scan.hpp
+ *
+ * Scanners which don't need a regular expression: a literal string, a jump to a character, one character of a set, or
+ * a run of characters from a set.  Each does what an Until with the equivalent regex (see Scan::regex) would, and leaves
+ * the same capture 0 in the Match, but with memchr and table lookups instead of boost.
+ */
+
+#include <cctype>
+#include <cstring>
+#include <cstdio>
+#include <string>
+
+#include "./SimpleGetSetDefault.hpp"
+#include "./RegexAtoms.hpp"
+
+namespace grammar {
+  class Branch;
+
+  /**
+   * a set of characters (for OneOf and TakeWhile)
+   */
+  class CharClass {
+    RegexAtoms::CharSet _set;
+  public:
+    /**
+     * @param chars the members of the class
+     */
+    CharClass(const std::string &chars) {
+      for(unsigned char c : chars) _set[c] = true;
+    }
+
+    CharClass(const char *chars) : CharClass( std::string(chars) ) {}
+
+    /**
+     * @param pred predicate in the style of <cctype>, like std::isdigit
+     */
+    CharClass(int (*pred)(int)) {
+      for(int c = 0; c < 256; ++c) _set[c] = pred(c) != 0;
+    }
+
+    bool operator[](unsigned char c) const { return _set[c]; }
+
+    /**
+     * @return a regex bracket expression matching the class
+     */
+    std::string bracket() const {
+      std::string result("[");
+      for(int c = 0; c < 256; ++c) {
+	if(!_set[c]) continue;
+	if( std::isalnum(c) ) result.push_back( char(c) );
+	else {
+	  char hex[8];
+	  std::snprintf(hex, sizeof(hex), "\\x%02x", c);
+	  result.append(hex);
+	}
+      }
+      return result.append("]");
+    }
+  };
+
+  /**
+   * Parent class for the scanners.  Like an Until, a Scan finds its match in the input, drops everything up to the end
+   * of the match, and makes the match capture 0; without a match (or with one more input might change, see
+   * Match::set_open_end) it asks for more input.
+   */
+  class Scan : public SimpleGetSetDefault {
+  protected:
+    /**
+     * find the match in input
+     *
+     * @param position receives the offset of the match
+     * @param length receives the length of the match
+     * @return true if there's a match
+     */
+    virtual bool find(const std::string &input, std::size_t &position, std::size_t &length) const = 0;
+
+    /* escape the regex metacharacters of s */
+    static std::string quote(const std::string &s) {
+      std::string result;
+      for(char c : s) {
+	if( std::strchr("\\^$.|?*+()[]{}", c) && c != '\0' ) result.push_back('\\');
+	result.push_back(c);
+      }
+      return result;
+    }
+  public:
+    Scan() { _default = nullptr; }
+
+    /**
+     * @return the regular expression this scan is equivalent to (used where a Pattern is needed, like a Branch case)
+     */
+    virtual std::string regex() const = 0;
+
+    /**
+     * @return true if the scan may match without consuming anything
+     */
+    virtual bool emptyP() const = 0;
+
+    Rule* operator()(Match &match, std::string &input, bool &more_chars) {
+      std::size_t position, length;
+      if( !find(input, position, length) || match.cut_short(position + length, input.size()) ) {
+	more_chars = true;
+	return this;
+      }
+
+      match.set_input(input).set_span(position, length);
+      input.erase(0, position + length);
+      more_chars = false;
+      return get_default();
+    }
+
+    std::string str() { return std::string("<scan {").append( regex() ).append("}>"); }
+
+    /**
+     * becomes a case of branch which scans the equivalent regex (defined with Branch)
+     */
+    bool add_as_case(Branch *branch);
+  };
+
+  /**
+   * finds a literal string (like re() with the string quoted)
+   */
+  class Literal : public Scan {
+    std::string _literal;
+  protected:
+    bool find(const std::string &input, std::size_t &position, std::size_t &length) const {
+      position = input.find(_literal);
+      length = _literal.size();
+      return position != std::string::npos;
+    }
+  public:
+    Literal(const std::string &literal) : _literal(literal) {}
+    std::string regex() const { return quote(_literal); }
+    bool emptyP() const { return _literal.empty(); }
+  };
+
+  /**
+   * takes everything before the next c, leaving c as the start of the input
+   */
+  class SkipTo : public Scan {
+    char _c;
+  protected:
+    bool find(const std::string &input, std::size_t &position, std::size_t &length) const {
+      const char *found = static_cast<const char*>( std::memchr(input.data(), _c, input.size()) );
+      position = 0;
+      length = found ? found - input.data() : 0;
+      return found != nullptr;
+    }
+  public:
+    SkipTo(char c) : _c(c) {}
+    std::string regex() const {
+      std::string c = quote( std::string(1, _c) );
+      return std::string("^[^").append(c).append("]*(?=").append(c).append(")");
+    }
+    bool emptyP() const { return true; }
+  };
+
+  /**
+   * finds the first character which is in a class
+   */
+  class OneOf : public Scan {
+    CharClass _class;
+  protected:
+    bool find(const std::string &input, std::size_t &position, std::size_t &length) const {
+      for(position = 0; position < input.size(); ++position)
+	if( _class[input[position]] ) {
+	  length = 1;
+	  return true;
+	}
+      return false;
+    }
+  public:
+    OneOf(const CharClass &cls) : _class(cls) {}
+    std::string regex() const { return _class.bracket(); }
+    bool emptyP() const { return false; }
+  };
+
+  /**
+   * takes the run of characters in a class at the start of the input (which may be empty)
+   */
+  class TakeWhile : public Scan {
+    CharClass _class;
+  protected:
+    bool find(const std::string &input, std::size_t &position, std::size_t &length) const {
+      position = 0;
+      for(length = 0; length < input.size() && _class[input[length]]; ++length);
+      return true;
+    }
+  public:
+    TakeWhile(const CharClass &cls) : _class(cls) {}
+    std::string regex() const { return std::string("^").append( _class.bracket() ).append("*"); }
+    bool emptyP() const { return true; }
+  };
+}
+
+#endif
@@ -20,8 +20,8 @@ namespace grammar {
   template<class R, class Key>
   class Singleton {
     R value_;
-    Singleton() {
-      /* rely on default constructor of value_ */
+    Singleton() : value_() {
+      /* value initialised, so a bool or number starts at zero */
     }
 
     Singleton(const Singleton&); /* forbidden */
@@ -0,0 +1,296 @@
+#ifndef GRAMMAR_SPECULATIVE_HPP
+#define GRAMMAR_SPECULATIVE_HPP
+/**
+ * @file grammar/Speculative.hpp
+ *
+ * Parses one large document on several threads by guessing the state the grammar will be in at chunk boundaries,
+ * checking the guesses in order, and parsing again where a guess was wrong.
+ */
+
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./Parser.hpp"
+
+namespace grammar {
+  /**
+   * Feeds a document to a grammar a line at a time, as a Parser would be fed, but cuts it into chunks and parses them
+   * on a pool of worker threads.  Every chunk after the first starts at a line the sync test accepts (a line starting
+   * with a tag, say), and is parsed on the guess that the grammar is waiting there at the sync label: where a parser
+   * started at that label comes to rest after an empty line.  The workers only scan, queueing their reductions (see
+   * Parser::batch_reductions).  The calling thread then takes the chunks in order: if the one before really did end
+   * in the guessed state, the chunk's reductions are applied as they are; otherwise they are dropped and the chunk is
+   * parsed again from the state the one before ended in.  Either way the actions see the same reductions, in the same
+   * order, as a single Parser would make, on the calling thread.
+   *
+   * States are compared by Parser::rule_id, so every worker's grammar has to be made by the same definition.  As with
+   * batched reductions, conditions in the grammar mustn't depend on what the actions do.
+   *
+   * If a line throws (a SyntaxError, say), the reductions before it are applied and the exception is rethrown by
+   * operator(); the document can't be carried on with after that (see reset).
+   */
+  class SpeculativeParser {
+  public:
+    typedef std::function<bool (const char *begin, const char *end)> SyncTest;
+  private:
+    static const std::size_t stopped = std::size_t(-1); /**< state of a parser which has run off its grammar */
+
+    class Chunk {
+    public:
+      const char *begin, *end;
+      std::size_t start, finish; /**< states (rule ids) it was parsed from and ended in */
+      ReductionQueue queue;
+      std::exception_ptr error;
+      bool done;
+    };
+
+    SyncTest _sync;
+    std::size_t _chunk_size;	/**< characters per chunk (rounded up to a sync line) */
+    ReduceThunk<std::function<void ()> > _line_end; /**< queued after each line */
+    std::vector<std::unique_ptr<Parser> > _parsers; /**< one for each worker */
+    Parser _repair;		/**< parses chunks again on the calling thread */
+    std::size_t _guess		/**< state at a sync line */
+      , _begin			/**< state at the start of a document */
+      , _state;			/**< state where the last call left the document */
+    std::size_t _reparsed;	/**< chunks parsed again (see reparsed) */
+    std::vector<std::thread> _workers;
+
+    std::mutex _lock;
+    std::condition_variable _work, _finished;
+    std::vector<std::unique_ptr<Chunk> > _chunks;
+    std::size_t _next;
+    bool _quit;
+
+    /* state of parse: its rule, past labels and gotos */
+    static std::size_t state(Parser &parse) {
+      Rule *r = Parser::settle(parse._rule);
+      return r ? parse.rule_id(r) : stopped;
+    }
+
+    static void set_state(Parser &parse, std::size_t state) {
+      parse._rule = state == stopped ? nullptr : parse.rule_at(state);
+      parse._scanned = Match();
+    }
+
+    void parse_chunk(Parser &parse, Chunk &chunk) {
+      std::string line;
+      chunk.queue.clear();
+      chunk.error = nullptr;
+      set_state(parse, chunk.start);
+      parse._defer = &chunk.queue;
+      try {
+	for(const char *p = chunk.begin; p < chunk.end; ) {
+	  const char *newline = static_cast<const char*>( std::memchr(p, '\n', chunk.end - p) );
+	  if(!newline) newline = chunk.end;
+
+	  line.assign(p, newline);
+	  parse(line);
+	  chunk.queue.push(&_line_end, parse._scanned, 0);
+	  p = newline + 1;
+	}
+      } catch(...) {
+	chunk.error = std::current_exception();
+      }
+      parse._defer = nullptr;
+      chunk.finish = state(parse);
+    }
+
+    void work(Parser &parse) {
+      for(;;) {
+	Chunk *chunk;
+	{
+	  std::unique_lock<std::mutex> lock(_lock);
+	  _work.wait(lock, [this]() { return _quit || _next < _chunks.size(); });
+	  if(_quit) return;
+	  chunk = _chunks[_next++].get();
+	}
+
+	parse_chunk(parse, *chunk);
+
+	{
+	  std::lock_guard<std::mutex> lock(_lock);
+	  chunk->done = true;
+	}
+	_finished.notify_all();
+      }
+    }
+
+    /* stop handing out chunks, and wait for those taken */
+    void abandon() {
+      std::unique_lock<std::mutex> lock(_lock);
+      std::size_t taken = _next;
+      _next = _chunks.size();
+      _finished.wait(lock, [&]() {
+	  for(std::size_t i = 0; i < taken; ++i) if( !_chunks[i]->done ) return false;
+	  return true;
+	});
+      _chunks.clear();
+      _next = 0;
+    }
+
+    /* the start of the first line at or after p the sync test accepts, or end */
+    const char* sync_line(const char *p, const char *end) {
+      while(p < end) {
+	const char *newline = static_cast<const char*>( std::memchr(p, '\n', end - p) );
+	if(!newline) return end;
+	p = newline + 1;
+	const char *line_end = static_cast<const char*>( std::memchr(p, '\n', end - p) );
+	if( p < end && _sync(p, line_end ? line_end : end) ) return p;
+      }
+      return end;
+    }
+  public:
+    /**
+     * @param grammar makes the grammar; called once for each worker, and once more, here on the calling thread
+     * @param sync_label where the grammar is guessed to be at a sync line
+     * @param sync accepts lines a chunk may start at (given the line, without its newline)
+     * @param threads number of workers (0 for one per core)
+     * @param chunk_size characters of input handed to a worker at once
+     * @throw std::runtime_error if the grammar has no sync_label
+     */
+    SpeculativeParser(const std::function<DefineGrammar ()> &grammar, const std::string &sync_label, const SyncTest &sync
+		      , unsigned threads = 0, std::size_t chunk_size = 1 << 20)
+      : _sync(sync), _chunk_size(chunk_size ? chunk_size : 1), _line_end( std::function<void ()>([]() {}) )
+      , _reparsed(0), _next(0), _quit(false) {
+      if(!threads) threads = std::thread::hardware_concurrency();
+      if(!threads) threads = 1;
+
+      _repair.sink( grammar() );
+      _repair.batch_reductions(true);
+      Label *label = _repair._root->find_label(sync_label);
+      if(!label) throw std::runtime_error("SpeculativeParser: the grammar has no label " + sync_label);
+
+      /* the guess: where a parser started at the label rests, with nothing more to go on */
+      ReductionQueue ignored;
+      std::string nothing;
+      _repair._rule = label;
+      _repair._defer = &ignored;
+      _repair(nothing);
+      _repair._defer = nullptr;
+      _guess = state(_repair);
+
+      _repair.reset();
+      _begin = _state = state(_repair);
+
+      for(unsigned i = 0; i < threads; ++i) {
+	_parsers.emplace_back(new Parser);
+	_parsers.back()->sink( grammar() );
+	_parsers.back()->batch_reductions(true);
+      }
+      for(unsigned i = 0; i < threads; ++i)
+	_workers.push_back( std::thread(&SpeculativeParser::work, this, std::ref(*_parsers[i])) );
+    }
+
+    SpeculativeParser(const SpeculativeParser&) = delete;
+
+    ~SpeculativeParser() {
+      {
+	std::lock_guard<std::mutex> lock(_lock);
+	_quit = true;
+      }
+      _work.notify_all();
+      for(auto &t : _workers) t.join();
+    }
+
+    /**
+     * call fn at the end of each line, in order with the reductions (to count lines, say)
+     */
+    void on_line(const std::function<void ()> &fn) { _line_end = ReduceThunk<std::function<void ()> >(fn); }
+
+    /**
+     * start the next call at the beginning of the grammar
+     */
+    void reset() { _state = _begin; }
+
+    /** @return how many chunks have had to be parsed again since construction */
+    std::size_t reparsed() const { return _reparsed; }
+
+    /** @return the number of workers */
+    std::size_t threads() const { return _workers.size(); }
+
+    /**
+     * parse the next size characters of the document (whole lines; the last needn't end in a newline), applying the
+     * reductions on this thread
+     */
+    void operator()(const char *data, std::size_t size) {
+      const char *end = data + size;
+      {
+	std::lock_guard<std::mutex> lock(_lock);
+	for(const char *p = data; p < end; ) {
+	  const char *q = std::size_t(end - p) > _chunk_size ? sync_line(p + _chunk_size - 1, end) : end;
+	  _chunks.emplace_back(new Chunk);
+	  _chunks.back()->begin = p;
+	  _chunks.back()->end = q;
+	  _chunks.back()->start = p == data ? _state : _guess;
+	  _chunks.back()->done = false;
+	  p = q;
+	}
+	_next = 0;
+      }
+      _work.notify_all();
+
+      for(std::size_t i = 0; i < _chunks.size(); ++i) {
+	Chunk *chunk;
+	{
+	  std::unique_lock<std::mutex> lock(_lock);
+	  chunk = _chunks[i].get();
+	  _finished.wait(lock, [chunk]() { return chunk->done; });
+	}
+
+	try {
+	  if(chunk->start != _state) {	/* guessed wrong */
+	    ++_reparsed;
+	    chunk->start = _state;
+	    parse_chunk(_repair, *chunk);
+	  }
+	  chunk->queue.apply();
+	  if(chunk->error) std::rethrow_exception(chunk->error);
+	} catch(...) {
+	  abandon();
+	  throw;
+	}
+	_state = chunk->finish;
+      }
+
+      std::lock_guard<std::mutex> lock(_lock);
+      _chunks.clear();
+      _next = 0;
+    }
+
+    void operator()(const std::string &text) { (*this)(text.data(), text.size()); }
+
+    /**
+     * parse all of in, reading window characters at a time
+     */
+    void operator()(std::istream &in, std::size_t window = 1 << 24) {
+      std::string buffer;
+      std::size_t carried = 0;	/* characters of a line begun in the last window */
+      while(in) {
+	buffer.resize(carried + window);
+	in.read(&buffer[carried], window);
+	buffer.resize( carried + in.gcount() );
+
+	std::size_t last = buffer.rfind('\n');
+	if(last == std::string::npos) {
+	  carried = buffer.size();
+	  continue;
+	}
+	(*this)(buffer.data(), last + 1);
+	buffer.erase(0, last + 1);
+	carried = buffer.size();
+      }
+      if( !buffer.empty() ) (*this)(buffer);
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,663 @@
+#ifndef GRAMMAR_STATICGRAMMAR_HPP
+#define GRAMMAR_STATICGRAMMAR_HPP
+/**
+ * @file grammar/StaticGrammar.hpp
+ *
+ * An expression template front end for grammar.  It uses the same vocabulary as DefineGrammar (re, branch, label, go,
+ * on_string, thunk ...) but every step of the grammar is a distinct type, so the generated StaticParser has no heap nodes,
+ * no virtual dispatch between sequential steps and no std::function wrapped actions.  Labels are named by tag types rather
+ * than strings, which lets the compiler check that every go<>() has exactly one label<>() to land on.
+ *
+ * @code
+ *   using namespace grammar::fixed;
+ *   struct top;
+ *   auto rules = label<top>().branch( re("^add\\s+(\\w+)").on_string(add, 1)
+ *                                    , re("^rm\\s+(\\w+)").on_string(rm, 1) ).go<top>();
+ *   StaticParser<decltype(rules)> parse(std::move(rules));
+ *   parse(line);
+ * @endcode
+ *
+ * The runtime semantics match the Parser/DefineGrammar pair: input is fed a line at a time, a scan which can't match waits
+ * for the next line, and a branch picks the earliest match (ties go to the first case listed).
+ */
+
+#include <string>
+#include <tuple>
+#include <utility>
+
+#include "./Match.hpp"
+#include "./Pattern.hpp"
+#include "./SyntaxError.hpp"
+
+namespace grammar {
+  namespace fixed {
+    /**
+     * control values returned by the exec members of grammar nodes.  Any non-negative value is the index of the node to
+     * resume at.
+     */
+    enum { fall_through = -1		/**< continue with the node following this one */
+	   , finished = -2 };		/**< the grammar has run off its end (same as Parser::is_leaf) */
+
+    /**
+     * state shared by all the nodes of a StaticParser; the equivalent of the (scanned, input, more_input_required)
+     * arguments of Rule::operator().
+     */
+    class StaticState {
+    public:
+      Match scanned;		/**< result of the most recent scan */
+      std::string *input;	/**< un-scanned characters */
+      bool more_input;		/**< set when a node needs another line before it can continue */
+
+      StaticState() : input(nullptr), more_input(false) {}
+    };
+
+    template<class... Nodes> class Seq;
+    template<class... Cases> class BranchNode;
+
+    /*****************************************************/
+    /*  compile time bookkeeping; node sizes and labels  */
+    /*****************************************************/
+    /**
+     * number of indices (resume points) a list of nodes occupies.
+     */
+    template<class... Nodes> struct size_of;
+    template<> struct size_of<> { static const int value = 0; };
+
+    template<class N, class... Rest>
+    struct size_of<N, Rest...> { static const int value = N::size + size_of<Rest...>::value; };
+
+    /**
+     * finds the index of label Tag within Node.
+     * count is the number of times the label is defined, offset is its index relative to the start of Node (or -1)
+     */
+    template<class Tag, class Node>
+    struct find_label {
+      static const int count = 0;
+      static const int offset = -1;
+    };
+
+    /**
+     * find_label over a list of nodes which starts at index Base
+     */
+    template<class Tag, int Base, class... Nodes> struct find_label_list;
+
+    template<class Tag, int Base>
+    struct find_label_list<Tag, Base> {
+      static const int count = 0;
+      static const int offset = -1;
+    };
+
+    template<class Tag, int Base, class N, class... Rest>
+    struct find_label_list<Tag, Base, N, Rest...> {
+      typedef find_label<Tag, N> here;
+      typedef find_label_list<Tag, Base + N::size, Rest...> rest;
+
+      static const int count = here::count + rest::count;
+      static const int offset = here::offset >= 0 ? Base + here::offset : rest::offset;
+    };
+
+    /**
+     * index of the node in Root labeled with Tag.  Fails to compile if the label isn't defined exactly once.
+     */
+    template<class Tag, class Root>
+    struct label_index {
+      typedef find_label<Tag, Root> found;
+      static_assert(found::count > 0, "go<Tag>() refers to a label<Tag>() which is not defined in this grammar.");
+      static_assert(found::count < 2, "label<Tag>() is defined more than once in this grammar.");
+      static const int value = found::offset;
+    };
+
+    /*****************************************************/
+    /*  leaf nodes                                       */
+    /*****************************************************/
+    /**
+     * the Until equivalent: scan input for a pattern, wait for more input if it isn't there.
+     */
+    class Scan {
+      Pattern _pattern;
+    public:
+      static const int size = 1;
+
+      Scan(const std::string &re) : _pattern(re) {}
+
+      Pattern& pattern() { return _pattern; }
+
+      template<class Root, int I, int Next>
+      int exec(StaticState &s) {
+	s.scanned.set_input(*s.input);
+	if( _pattern.find(s.scanned) ) {
+	  *s.input = s.scanned.suffix();
+	  return fall_through;
+	}
+
+	s.more_input = true;
+	return I;
+      }
+    };
+
+    /**
+     * case head which always matches; only meaningful as the first node of a branch case.
+     */
+    class OtherwiseNode {
+    public:
+      static const int size = 1;
+
+      template<class Root, int I, int Next>
+      int exec(StaticState &s) { return fall_through; }
+    };
+
+    /**
+     * call hook with one capture of the last scan.  The hook's type is a template parameter so the call is direct.
+     */
+    template<class F>
+    class OnString {
+      F _hook;
+      int _index;
+    public:
+      static const int size = 1;
+
+      OnString(F hook, int index) : _hook(std::move(hook)), _index(index) {}
+
+      template<class Root, int I, int Next>
+      int exec(StaticState &s) {
+	_hook( s.scanned[_index] );
+	return fall_through;
+      }
+    };
+
+    /**
+     * call hook with the Match of the last scan.
+     */
+    template<class F>
+    class OnMatch {
+      F _hook;
+    public:
+      static const int size = 1;
+
+      OnMatch(F hook) : _hook(std::move(hook)) {}
+
+      template<class Root, int I, int Next>
+      int exec(StaticState &s) {
+	_hook( s.scanned );
+	return fall_through;
+      }
+    };
+
+    /**
+     * call hook with no arguments.
+     */
+    template<class F>
+    class Thunk {
+      F _hook;
+    public:
+      static const int size = 1;
+
+      Thunk(F hook) : _hook(std::move(hook)) {}
+
+      template<class Root, int I, int Next>
+      int exec(StaticState &s) {
+	_hook();
+	return fall_through;
+      }
+    };
+
+    /**
+     * throw a SyntaxError with the last scan appended to the message.
+     */
+    class Error {
+      std::string _msg;
+    public:
+      static const int size = 1;
+
+      Error(const std::string &msg) : _msg(msg) {}
+
+      template<class Root, int I, int Next>
+      int exec(StaticState &s) {
+	throw SyntaxError( std::string(_msg).append(s.scanned[0]) );
+      }
+    };
+
+    /**
+     * tell the parser to wait for more input, then carry on with the following node.
+     */
+    class StopNode {
+    public:
+      static const int size = 1;
+
+      template<class Root, int I, int Next>
+      int exec(StaticState &s) {
+	s.more_input = true;
+	return Next;
+      }
+    };
+
+    /**
+     * a point go<Tag>() can jump to.
+     */
+    template<class Tag>
+    class LabelNode {
+    public:
+      static const int size = 1;
+
+      template<class Root, int I, int Next>
+      int exec(StaticState &s) { return fall_through; }
+    };
+
+    template<class Tag>
+    struct find_label<Tag, LabelNode<Tag> > {
+      static const int count = 1;
+      static const int offset = 0;
+    };
+
+    /**
+     * jump to label<Tag>(); the destination is resolved (and checked) when the node is compiled.
+     */
+    template<class Tag>
+    class GoNode {
+    public:
+      static const int size = 1;
+
+      template<class Root, int I, int Next>
+      int exec(StaticState &s) { return label_index<Tag, Root>::value; }
+    };
+
+    /*****************************************************/
+    /*  sequences                                        */
+    /*****************************************************/
+    /**
+     * a run of nodes executed in order.  Seq is both the building block returned by the DSL functions and a node which can
+     * be nested (as a branch case).
+     *
+     * Nodes following each other are called directly (and can be inlined); control only returns to the StaticParser
+     * trampoline on a go<>(), or when a node waits for input.
+     *
+     * The builders (re, on_string, branch, ...) move the nodes out of the sequence into the one they return, so they
+     * only take an rvalue: to build two grammars from one start, build the start twice (or std::move it into the last).
+     */
+    template<class... Nodes>
+    class Seq {
+      template<class... T> friend class Seq;
+      template<class... T> friend class BranchNode;
+
+      typedef std::tuple<Nodes...> tuple_type;
+      tuple_type _nodes;
+
+      static const int count = sizeof...(Nodes);
+
+      /** index of the J'th node, relative to the start of the sequence */
+      template<int J, class Dummy = void>
+      struct offset {
+	static const int value = offset<J - 1>::value + std::tuple_element<J - 1, tuple_type>::type::size;
+      };
+
+      template<class Dummy>
+      struct offset<0, Dummy> { static const int value = 0; };
+
+      /* the J'th node's resume index and the index which follows it */
+      template<int Base, int Next, int J>
+      struct place {
+	static const int index = Base + offset<J>::value;
+	static const int next = (J + 1 < count) ? Base + offset<J + 1>::value : Next;
+      };
+
+      /* run nodes J, J+1, ... until one of them jumps or waits */
+      template<class Root, int Base, int Next, int J>
+      typename std::enable_if<(J < count), int>::type run_from(StaticState &s) {
+	typedef place<Base, Next, J> at;
+	int r = std::get<J>(_nodes).template exec<Root, at::index, at::next>(s);
+	if(r == fall_through) return run_from<Root, Base, Next, J + 1>(s);
+	return r;
+      }
+
+      template<class Root, int Base, int Next, int J>
+      typename std::enable_if<(J >= count), int>::type run_from(StaticState &s) { return fall_through; }
+
+      /* find the node holding index I and resume there */
+      template<class Root, int Base, int Next, int I, int J>
+      typename std::enable_if<(J < count), int>::type resume_from(StaticState &s) {
+	typedef place<Base, Next, J> at;
+	typedef typename std::tuple_element<J, tuple_type>::type node_type;
+
+	if(I >= at::index + node_type::size)
+	  return resume_from<Root, Base, Next, I, J + 1>(s);
+
+	int r = resume_node<Root, at::index, at::next, I>(std::get<J>(_nodes), s, 0);
+	if(r == fall_through) return run_from<Root, Base, Next, J + 1>(s);
+	return r;
+      }
+
+      template<class Root, int Base, int Next, int I, int J>
+      typename std::enable_if<(J >= count), int>::type resume_from(StaticState &s) { return fall_through; }
+
+      /* nested nodes (Seq, BranchNode) have their own resume; leaves just run */
+      template<class Root, int Base, int Next, int I, class N>
+      static auto resume_node(N &node, StaticState &s, int) -> decltype(node.template resume<Root, Base, Next, I>(s)) {
+	return node.template resume<Root, Base, Next, I>(s);
+      }
+
+      template<class Root, int Base, int Next, int I, class N>
+      static int resume_node(N &node, StaticState &s, long) {
+	return node.template exec<Root, Base, Next>(s);
+      }
+
+      /* build a sequence with one more node, out of this one */
+      template<class N>
+      Seq<Nodes..., N> push(N &&node) && {
+	return Seq<Nodes..., N>( std::tuple_cat(std::move(_nodes), std::make_tuple(std::move(node))) );
+      }
+    public:
+      static const int size = size_of<Nodes...>::value;
+
+      Seq() = default;
+      Seq(Seq&&) = default;
+      explicit Seq(tuple_type &&nodes) : _nodes(std::move(nodes)) {}
+
+      /** the first node of the sequence, used by BranchNode to test case heads */
+      template<int J = 0>
+      typename std::tuple_element<J, tuple_type>::type& head() { return std::get<J>(_nodes); }
+
+      /** run the sequence from its first node */
+      template<class Root, int Base, int Next>
+      int exec(StaticState &s) { return run_from<Root, Base, Next, 0>(s); }
+
+      /** run the sequence after its first node (the case head, which BranchNode has already applied) */
+      template<class Root, int Base, int Next>
+      int exec_tail(StaticState &s) { return run_from<Root, Base, Next, 1>(s); }
+
+      /** start at index I, somewhere in this sequence */
+      template<class Root, int Base, int Next, int I>
+      int resume(StaticState &s) { return resume_from<Root, Base, Next, I, 0>(s); }
+
+      //! make a regular expression
+      Seq<Nodes..., Scan> re(const std::string &pattern) && { return std::move(*this).push( Scan(pattern) ); }
+
+      //! make a case insensitive regular expression
+      Seq<Nodes..., Scan> re_i(const std::string &pattern) && {
+	Scan scan(pattern);
+	scan.pattern().set_flag(boost::regex::icase);
+	return std::move(*this).push( std::move(scan) );
+      }
+
+      //! call hook with capture index of the last scan
+      template<class F>
+      Seq<Nodes..., OnString<F> > on_string(F hook, int index = 0) && {
+	return std::move(*this).push( OnString<F>(std::move(hook), index) );
+      }
+
+      //! call hook with the Match of the last scan
+      template<class F>
+      Seq<Nodes..., OnMatch<F> > on_match(F hook) && { return std::move(*this).push( OnMatch<F>(std::move(hook)) ); }
+
+      //! call hook with no arguments
+      template<class F>
+      Seq<Nodes..., Thunk<F> > thunk(F hook) && { return std::move(*this).push( Thunk<F>(std::move(hook)) ); }
+
+      //! discard the last scan
+      Seq<Nodes..., Thunk<void (*)()> > ignore() && {
+	return std::move(*this).thunk( static_cast<void (*)()>([](){}) );
+      }
+
+      //! throw a SyntaxError if reached
+      Seq<Nodes..., Error> error(const std::string &msg) && { return std::move(*this).push( Error(msg) ); }
+
+      //! wait for more input before continuing
+      Seq<Nodes..., StopNode> stop() && { return std::move(*this).push( StopNode() ); }
+
+      //! label the current point as Tag
+      template<class Tag>
+      Seq<Nodes..., LabelNode<Tag> > label() && { return std::move(*this).push( LabelNode<Tag>() ); }
+
+      //! jump to label Tag
+      template<class Tag>
+      Seq<Nodes..., GoNode<Tag> > go() && { return std::move(*this).push( GoNode<Tag>() ); }
+
+      //! add a branch; each case must be a Seq beginning with re(...) or otherwise()
+      template<class... Cases>
+      Seq<Nodes..., BranchNode<Cases...> > branch(Cases&&... cases) &&;
+
+      //! add the nodes of another sequence to the end of this one
+      template<class... Others>
+      Seq<Nodes..., Others...> append(Seq<Others...> &&other) && {
+	return Seq<Nodes..., Others...>( std::tuple_cat(std::move(_nodes), std::move(other._nodes)) );
+      }
+    };
+
+    template<class Tag, class... Nodes>
+    struct find_label<Tag, Seq<Nodes...> > : find_label_list<Tag, 0, Nodes...> {};
+
+    /*****************************************************/
+    /*  branches                                         */
+    /*****************************************************/
+    /**
+     * the Branch equivalent.  Tests the head of each case, takes the earliest match (or the first Otherwise reached) and
+     * continues with the rest of that case.  Occupies one index for itself, followed by the indices of its cases.
+     */
+    template<class... Cases>
+    class BranchNode {
+      typedef std::tuple<Cases...> tuple_type;
+      tuple_type _cases;
+
+      static const int count = sizeof...(Cases);
+
+      template<int J, class Dummy = void>
+      struct offset {
+	static const int value = offset<J - 1>::value + std::tuple_element<J - 1, tuple_type>::type::size;
+      };
+
+      template<class Dummy>
+      struct offset<0, Dummy> { static const int value = 1; };
+
+      /* the result of testing one case head */
+      static bool test(Scan &head, Match &m) { return head.pattern().find(m); }
+      static bool test(OtherwiseNode &head, Match &m) { return true; }
+      static bool otherwiseP(Scan&) { return false; }
+      static bool otherwiseP(OtherwiseNode&) { return true; }
+
+      template<int J>
+      typename std::enable_if<(J < count)>::type choose(Match &m, int &chosen, int &chosen_pos) {
+	auto &head = std::get<J>(_cases).head();
+	if( otherwiseP(head) ) {
+	  chosen = J;
+	  chosen_pos = -1;
+	  return;
+	}
+	if( test(head, m) ) {
+	  int pos = m.match.position();
+	  if(pos == 0) {
+	    chosen = J;
+	    chosen_pos = 0;
+	    return;
+	  }
+	  if(chosen < 0 || pos < chosen_pos) {
+	    chosen = J;
+	    chosen_pos = pos;
+	  }
+	}
+	choose<J + 1>(m, chosen, chosen_pos);
+      }
+
+      template<int J>
+      typename std::enable_if<(J >= count)>::type choose(Match &m, int &chosen, int &chosen_pos) {}
+
+      /* re-apply the winning pattern if a later case overwrote its Match */
+      template<int J>
+      typename std::enable_if<(J < count)>::type rescan(int chosen, Match &m) {
+	if(J == chosen) test(std::get<J>(_cases).head(), m);
+	else rescan<J + 1>(chosen, m);
+      }
+
+      template<int J>
+      typename std::enable_if<(J >= count)>::type rescan(int chosen, Match &m) {}
+
+      template<class Root, int Base, int Next, int J>
+      typename std::enable_if<(J < count), int>::type run_case(int chosen, StaticState &s) {
+	if(J == chosen)
+	  return std::get<J>(_cases).template exec_tail<Root, Base + offset<J>::value, Next>(s);
+	return run_case<Root, Base, Next, J + 1>(chosen, s);
+      }
+
+      template<class Root, int Base, int Next, int J>
+      typename std::enable_if<(J >= count), int>::type run_case(int chosen, StaticState &s) { return fall_through; }
+
+      template<class Root, int Base, int Next, int I, int J>
+      typename std::enable_if<(J < count), int>::type resume_case(StaticState &s) {
+	typedef typename std::tuple_element<J, tuple_type>::type case_type;
+	if(I >= Base + offset<J>::value + case_type::size)
+	  return resume_case<Root, Base, Next, I, J + 1>(s);
+	return std::get<J>(_cases).template resume<Root, Base + offset<J>::value, Next, I>(s);
+      }
+
+      template<class Root, int Base, int Next, int I, int J>
+      typename std::enable_if<(J >= count), int>::type resume_case(StaticState &s) { return fall_through; }
+    public:
+      static const int size = 1 + size_of<Cases...>::value;
+
+      BranchNode(BranchNode&&) = default;
+      BranchNode(Cases&&... cases) : _cases(std::move(cases)...) {}
+
+      template<class Root, int I, int Next>
+      int exec(StaticState &s) {
+	if(s.input->empty()) {
+	  s.more_input = true;
+	  return I;
+	}
+
+	int chosen = -1, chosen_pos = -1;
+	s.scanned.set_input(*s.input);
+	choose<0>(s.scanned, chosen, chosen_pos);
+
+	/* no match; like a Branch with no more_chars, carry on past the branch */
+	if(chosen < 0) return fall_through;
+
+	if(chosen_pos >= 0) {
+	  if(chosen_pos != 0) rescan<0>(chosen, s.scanned);
+	  *s.input = s.scanned.suffix();
+	}
+	return run_case<Root, I, Next, 0>(chosen, s);
+      }
+
+      template<class Root, int Base, int Next, int I>
+      int resume(StaticState &s) {
+	if(I == Base) return exec<Root, Base, Next>(s);
+	return resume_case<Root, Base, Next, I, 0>(s);
+      }
+    };
+
+    template<class Tag, class... Cases>
+    struct find_label<Tag, BranchNode<Cases...> > : find_label_list<Tag, 1, Cases...> {};
+
+    template<class... Nodes>
+    template<class... Cases>
+    Seq<Nodes..., BranchNode<Cases...> > Seq<Nodes...>::branch(Cases&&... cases) && {
+      return std::move(*this).push( BranchNode<Cases...>(std::move(cases)...) );
+    }
+
+    /*****************************************************/
+    /*  parser                                           */
+    /*****************************************************/
+    template<int... I> struct indices {};
+
+    template<int N, int... I>
+    struct make_indices : make_indices<N - 1, N - 1, I...> {};
+
+    template<int... I>
+    struct make_indices<0, I...> { typedef indices<I...> type; };
+
+    /**
+     * the StaticParser equivalent of Parser.  Owns its grammar by value; operator() is a trampoline over the grammar's
+     * resume indices which only bounces on a go<>() or when a node waits for more input.
+     *
+     * @tparam Grammar the Seq built with the fixed DSL
+     */
+    template<class Grammar>
+    class StaticParser {
+      typedef int (*resume_fn)(Grammar&, StaticState&);
+
+      Grammar _grammar;		/**< the rules */
+      StaticState _state;	/**< scanned string etc. */
+      int _at;			/**< index to resume at, or finished */
+
+      template<int I>
+      static int resume_at(Grammar &g, StaticState &s) {
+	return g.template resume<Grammar, 0, finished, I>(s);
+      }
+
+      template<int... I>
+      static const resume_fn* table(indices<I...>) {
+	static const resume_fn fns[] = { &resume_at<I>... };
+	return fns;
+      }
+
+      static const resume_fn* table() { return table( typename make_indices<Grammar::size>::type() ); }
+    public:
+      StaticParser(const StaticParser&) = delete;
+
+      /**
+       * take the grammar
+       */
+      StaticParser(Grammar &&grammar) : _grammar(std::move(grammar)), _at(0) {}
+
+      /**
+       * parse a string untill it is consumed.
+       *
+       * @param input the string to parse
+       */
+      void operator()(std::string &input) {
+	static const resume_fn *fns = table();
+	_state.input = &input;
+	_state.more_input = false;
+
+	while(_at >= 0 && !_state.more_input) {
+	  int r = fns[_at](_grammar, _state);
+	  _at = (r == fall_through) ? static_cast<int>(finished) : r;
+	}
+      }
+
+      /**
+       * alternate form of operator(), parses a copy of input
+       */
+      void operator()(const std::string &input) {
+	std::string copy = input;
+	(*this)(copy);
+      }
+
+      /**
+       * begin parsing the next input from the start of the grammar
+       */
+      void reset() { _at = 0; }
+
+      /**
+       * true if the grammar has run off its end
+       */
+      bool is_leaf() { return _at < 0; }
+    };
+
+    /**
+     * sink a fixed grammar into a StaticParser (allocated on the heap so the parser's type can stay implicit).
+     */
+    template<class Grammar>
+    StaticParser<Grammar>* make_parser(Grammar &&grammar) { return new StaticParser<Grammar>(std::move(grammar)); }
+
+    /*****************************************************/
+    /*  nameless sequences                               */
+    /*****************************************************/
+    //! a sequence starting with a regular expression
+    inline Seq<Scan> re(const std::string &pattern) { return Seq<>().re(pattern); }
+
+    //! a sequence starting with a case insensitive regular expression
+    inline Seq<Scan> re_i(const std::string &pattern) { return Seq<>().re_i(pattern); }
+
+    //! a sequence starting with a label
+    template<class Tag>
+    Seq<LabelNode<Tag> > label() { return Seq<>().label<Tag>(); }
+
+    //! a sequence which immediately jumps to a label
+    template<class Tag>
+    Seq<GoNode<Tag> > go() { return Seq<>().go<Tag>(); }
+
+    //! a branch case which is always taken
+    inline Seq<OtherwiseNode> otherwise() { return Seq<OtherwiseNode>( std::make_tuple(OtherwiseNode()) ); }
+  }
+}
+
+#endif
@@ -51,9 +51,38 @@ namespace grammar {
      * 
      * @return string representation of SyntaxError
      */
-    const char* what() const throw() { return str().c_str(); }
+    const char* what() const throw() { return message_.c_str(); }
   };
 
+  /**
+   * Rule which raises a SyntaxError (see DefineGrammar::error).  Nothing follows it, which lets the passes over the grammar
+   * treat it as an exit.
+   */
+  class RaiseSyntaxError : public Reduce {
+    std::string _message;	/**< prefix of the error message, the scanned string is appended */
+  public:
+    /**
+     * @param msg message of the SyntaxError
+     */
+    RaiseSyntaxError(const std::string &msg) : _message(msg) {}
+
+    /**
+     * throw a SyntaxError with the scanned string appended to the message
+     */
+    Rule* operator()(Match &scanned, std::string &input, bool &more_chars) {
+      throw SyntaxError( std::string(_message).append(scanned[0]) );
+    }
+
+    /**
+     * string representation
+     */
+    std::string str() { return std::string("<error: ").append(_message).append(">"); }
+
+    /**
+     * an error doesn't pass control to anything
+     */
+    void for_successors(const std::function<void (Rule*)> &fn) {}
+  };
 }
 
 #endif
@@ -0,0 +1,122 @@
+#ifndef GRAMMAR_TOKENS_HPP
+#define GRAMMAR_TOKENS_HPP
+/**
+ * @file grammar/Tokens.hpp
+ *
+ * Pull-style access to a Parser: iterate over its reductions instead of (or as well as) receiving callbacks.
+ */
+
+#include <iterator>
+#include <string>
+#include <unordered_map>
+
+#include "./Parser.hpp"
+
+namespace grammar {
+  /**
+   * what a Parser is about to reduce: which reduction, the captures of the scan before it, and the label it was reached
+   * under.  Nothing is copied: the token refers into the parser and is only good until the next token is taken.
+   */
+  class Token {
+  public:
+    std::size_t rule;		/**< id of the reduction (see Parser::rule_id) */
+    const std::string *label;	/**< name of the last label passed, other than branch ends ("" before any) */
+    const Match *match;		/**< captures of the last scan */
+
+    /** number of captures, including the whole match */
+    std::size_t size() const { return match->size(); }
+
+    /** offset of capture index in the scanned input (-1 if unmatched) */
+    std::ptrdiff_t position(std::size_t index = 0) const { return match->position(index); }
+
+    /** length of capture index */
+    std::ptrdiff_t length(std::size_t index = 0) const { return match->length(index); }
+
+    /** first character of capture index (valid with the token) */
+    const char* data(std::size_t index = 0) const {
+      return match->input().data() + (match->matched(index) ? position(index) : 0);
+    }
+
+    /** copy of capture index, for when the token has to outlive the iteration */
+    std::string str(std::size_t index = 0) const { return (*match)[index]; }
+  };
+
+  /**
+   * the reductions a Parser makes on one input, as a lazily evaluated range: the parser only runs as far as the token
+   * being asked for, so stopping early leaves the rest of the input unparsed (input holds it).  Each reduction's own
+   * callback runs when the token after it is taken.
+   *
+   * for(auto tok : parse.tokens(buf)) ...
+   */
+  class Tokens {
+    Parser &_parse;
+    std::string &_input;
+    Token _token;
+    bool _more_input	       /**< the parser wants more input */
+      , _pending;	       /**< _token is for _parse's current rule, which hasn't been applied yet */
+    std::size_t _left, _stalled; /**< for Parser::step */
+
+    static const std::string& no_label() {
+      static const std::string empty;
+      return empty;
+    }
+
+    /* run up to the next reduction; false if there isn't one in the input */
+    bool advance() {
+      while(_parse._rule && !_more_input) {
+	Rule *r = _parse._rule;
+
+	if(!_pending && dynamic_cast<Reduce*>(r)) {
+	  _token.rule = _parse.rule_id(r);
+	  _pending = true;
+	  return true;
+	}
+	_pending = false;
+
+	Label *label = dynamic_cast<Label*>(r);
+	GotoLabel *go;
+	if( !label && (go = dynamic_cast<GotoLabel*>(r)) ) label = go->get_label();
+	if(label && label->get_name() != "post-branch") _token.label = &label->get_name();
+
+	_parse.step(_parse._scanned, _input, _more_input, _left, _stalled);
+      }
+      return false;
+    }
+  public:
+    Tokens(Parser &parse, std::string &input)
+      : _parse(parse), _input(input), _more_input(false), _pending(false), _left(input.size()), _stalled(0) {
+      _token.rule = 0;
+      _token.label = &no_label();
+      _token.match = &parse._scanned;
+      parse._scanned.set_open_end(false);
+    }
+
+    class iterator {
+      Tokens *_tokens;		/**< nullptr at the end */
+    public:
+      typedef std::input_iterator_tag iterator_category;
+      typedef Token value_type;
+      typedef std::ptrdiff_t difference_type;
+      typedef const Token* pointer;
+      typedef const Token& reference;
+
+      explicit iterator(Tokens *t = nullptr) : _tokens(t) {}
+      const Token& operator*() const { return _tokens->_token; }
+      const Token* operator->() const { return &_tokens->_token; }
+      iterator& operator++() {
+	if( !_tokens->advance() ) _tokens = nullptr;
+	return *this;
+      }
+      bool operator==(const iterator &other) const { return _tokens == other._tokens; }
+      bool operator!=(const iterator &other) const { return _tokens != other._tokens; }
+    };
+
+    /** runs to the first reduction; only call once */
+    iterator begin() { return iterator( advance() ? this : nullptr ); }
+    iterator end() { return iterator(); }
+  };
+
+  inline Tokens Parser::tokens(std::string &input) { return Tokens(*this, input); }
+}
+
+#endif
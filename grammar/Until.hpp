@@ -64,9 +64,9 @@ namespace grammar {
 #endif
       match.set_input(input);
 
-      if( _pattern->find(match) ) {
+      if( _pattern->find(match) && !match.cut_short(match.suffix_position(), input.size()) ) {
 	/* keep string after match as input */
-	input = match.suffix();
+	input.erase(0, match.suffix_position());
 	more_chars = false;
 #ifdef DEBUG_UNTIL
 	if(RunVerbose<Until>::P() ) {	
@@ -76,7 +76,7 @@ namespace grammar {
 	return get_default();
       }
 
-      /* no match, ask for more input */
+      /* no match (or one which more input might change), ask for more input */
       else {
 #ifdef DEBUG_UNTIL
 	if(RunVerbose<Until>::P() ) {
@@ -116,6 +116,11 @@ namespace grammar {
     Pattern* get_pattern() {
       return _pattern;
     }
+
+    /**
+     * becomes a case of branch which scans my pattern (defined with Branch)
+     */
+    bool add_as_case(Branch *branch);
   };
 }
 
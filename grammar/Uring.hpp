@@ -0,0 +1,274 @@
+#ifndef GRAMMAR_URING_HPP
+#define GRAMMAR_URING_HPP
+/**
+ * @file grammar/Uring.hpp
+ *
+ * An input source for InputPipeline which reads a file with io_uring (Linux), straight into the pipeline's buffers,
+ * registered with the kernel, with a read in flight for each free buffer.  Where io_uring isn't there (an old kernel,
+ * or one with it switched off, or not Linux) it reads with pread instead.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define GRAMMAR_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "./Pipeline.hpp"
+
+namespace grammar {
+  /**
+   * Reads a file into an InputPipeline's buffers (see InputPipeline(AsyncSource&, ...)); the pipeline's depth is the
+   * number of reads in flight.  The buffers are registered with the ring, so the kernel needn't map them for each read;
+   * if that's refused (a low RLIMIT_MEMLOCK, say) reads use plain iovecs instead.
+   *
+   * Optionally the file is opened with O_DIRECT, skipping the page cache; that needs buffers of a multiple of 4096
+   * characters, and a filesystem which allows it, and is quietly dropped otherwise.
+   *
+   * A read which comes back short is carried on from where it stopped (see AsyncSource::submit), as pread would be;
+   * with O_DIRECT, one which stops off a 4096 character boundary has reached the end of the file.
+   */
+  class UringSource : public AsyncSource {
+    int _fd;
+    bool _direct;		/**< the file is open with O_DIRECT */
+    std::uint64_t _offset;	/**< where the next read starts */
+    std::vector<std::uint64_t> _starts; /**< where each buffer's read started, to carry it on */
+    std::size_t _size;		/**< characters in each buffer */
+    std::vector<char*> _buffers;
+    std::vector<iovec> _iovecs;
+    std::deque< std::pair<std::size_t, std::ptrdiff_t> > _done; /**< reads made by pread, for complete */
+
+#ifdef GRAMMAR_HAVE_IO_URING
+    int _ring;			/**< the io_uring, or -1 if there isn't one */
+    bool _registered;		/**< _buffers are registered with it */
+    void *_sq_map, *_cq_map;
+    std::size_t _sq_map_size, _cq_map_size, _sqes_size;
+    io_uring_sqe *_sqes;
+    unsigned *_sq_tail, *_sq_mask, *_sq_array, *_cq_head, *_cq_tail, *_cq_mask;
+    io_uring_cqe *_cqes;
+
+    static int enter(int ring, unsigned submit, unsigned wait) {
+      int result;
+      do result = syscall(__NR_io_uring_enter, ring, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+      while(result < 0 && errno == EINTR);
+      return result;
+    }
+
+    /* set up a ring of entries; leaves _ring at -1 if the kernel won't */
+    void setup(unsigned entries) {
+      io_uring_params params;
+      std::memset(&params, 0, sizeof(params));
+      int ring = syscall(__NR_io_uring_setup, entries, &params);
+      if(ring < 0) return;
+
+      _sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+      _cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+      bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+      if(single) _sq_map_size = _cq_map_size = std::max(_sq_map_size, _cq_map_size);
+      _sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+      const int prot = PROT_READ | PROT_WRITE, flags = MAP_SHARED | MAP_POPULATE;
+      _sq_map = mmap(nullptr, _sq_map_size, prot, flags, ring, IORING_OFF_SQ_RING);
+      _cq_map = single ? _sq_map : mmap(nullptr, _cq_map_size, prot, flags, ring, IORING_OFF_CQ_RING);
+      void *sqes = mmap(nullptr, _sqes_size, prot, flags, ring, IORING_OFF_SQES);
+      if(_sq_map == MAP_FAILED || _cq_map == MAP_FAILED || sqes == MAP_FAILED) {
+	if(_sq_map != MAP_FAILED) munmap(_sq_map, _sq_map_size);
+	if(!single && _cq_map != MAP_FAILED) munmap(_cq_map, _cq_map_size);
+	if(sqes != MAP_FAILED) munmap(sqes, _sqes_size);
+	_sq_map = _cq_map = nullptr;
+	close(ring);
+	return;
+      }
+
+      char *sq = static_cast<char*>(_sq_map), *cq = static_cast<char*>(_cq_map);
+      _sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+      _sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+      _sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+      _cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+      _cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+      _cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+      _cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+      _sqes = static_cast<io_uring_sqe*>(sqes);
+      _ring = ring;
+    }
+#endif
+
+    /* read buffer index from character from with pread, for complete to hand back */
+    void read_now(std::size_t index, std::size_t from) {
+      std::size_t got = from;
+      std::ptrdiff_t n = 0;
+      while( got < _size && (n = pread(_fd, _buffers[index] + got, _size - got, _starts[index] + got)) != 0 ) {
+	if(n < 0) {
+	  if(errno == EINTR) continue;
+	  break;
+	}
+	got += n;
+      }
+      _done.push_back( std::make_pair(index, n < 0 ? -std::ptrdiff_t(errno) : std::ptrdiff_t(got - from)) );
+    }
+  public:
+    /**
+     * open path for reading
+     *
+     * @param direct read with O_DIRECT, if the file and the buffers allow it
+     * @throw std::runtime_error if the file can't be opened
+     */
+    explicit UringSource(const std::string &path, bool direct = false)
+      : _fd(-1), _direct(false), _offset(0), _size(0) {
+#ifdef GRAMMAR_HAVE_IO_URING
+      _ring = -1;
+      _registered = false;
+      _sq_map = _cq_map = nullptr;
+#endif
+#ifdef O_DIRECT
+      if(direct && (_fd = open(path.c_str(), O_RDONLY | O_DIRECT)) >= 0) _direct = true;
+#endif
+      if(_fd < 0 && (_fd = open(path.c_str(), O_RDONLY)) < 0)
+	throw std::runtime_error("UringSource: can't open " + path + ": " + std::strerror(errno));
+    }
+
+    UringSource(const UringSource&) = delete;
+
+    ~UringSource() {
+#ifdef GRAMMAR_HAVE_IO_URING
+      if(_ring >= 0) {
+	munmap(_sqes, _sqes_size);
+	if(_cq_map != _sq_map) munmap(_cq_map, _cq_map_size);
+	munmap(_sq_map, _sq_map_size);
+	close(_ring);
+      }
+#endif
+      close(_fd);
+    }
+
+    /** @return true if reading with io_uring, false if with pread */
+    bool uring() const {
+#ifdef GRAMMAR_HAVE_IO_URING
+      return _ring >= 0;
+#else
+      return false;
+#endif
+    }
+
+    /** @return true if the buffers are registered with the ring */
+    bool registered() const {
+#ifdef GRAMMAR_HAVE_IO_URING
+      return _registered;
+#else
+      return false;
+#endif
+    }
+
+    /** @return true if reading past the page cache (O_DIRECT) */
+    bool direct() const { return _direct; }
+
+    void attach(char *const *buffers, std::size_t count, std::size_t size) {
+      _buffers.assign(buffers, buffers + count);
+      _starts.assign(count, 0);
+      _size = size;
+      _iovecs.resize(count);
+      for(std::size_t i = 0; i < count; ++i) {
+	_iovecs[i].iov_base = buffers[i];
+	_iovecs[i].iov_len = size;
+      }
+
+#ifdef O_DIRECT
+      if(_direct && size % 4096) {
+	fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) & ~O_DIRECT);
+	_direct = false;
+      }
+#endif
+#ifdef GRAMMAR_HAVE_IO_URING
+      setup(count);
+      if(_ring >= 0)
+	_registered = syscall(__NR_io_uring_register, _ring, IORING_REGISTER_BUFFERS, _iovecs.data(), count) == 0;
+#endif
+    }
+
+    void submit(std::size_t index, std::size_t from = 0) {
+      if(!from) {
+	_starts[index] = _offset;
+	_offset += _size;
+      }
+      else if(_direct && from % 4096) {
+	/* O_DIRECT can't read from there, and the file ended anyway */
+	_done.push_back( std::make_pair(index, std::ptrdiff_t(0)) );
+	return;
+      }
+#ifdef GRAMMAR_HAVE_IO_URING
+      if(_ring >= 0) {
+	unsigned tail = *_sq_tail, slot = tail & *_sq_mask;
+	io_uring_sqe &sqe = _sqes[slot];
+	std::memset(&sqe, 0, sizeof(sqe));
+	sqe.fd = _fd;
+	sqe.off = _starts[index] + from;
+	sqe.user_data = index;
+	if(_registered) {
+	  sqe.opcode = IORING_OP_READ_FIXED;
+	  sqe.addr = reinterpret_cast<std::uint64_t>(_buffers[index] + from);
+	  sqe.len = _size - from;
+	  sqe.buf_index = index;
+	}
+	else {
+	  _iovecs[index].iov_base = _buffers[index] + from;
+	  _iovecs[index].iov_len = _size - from;
+	  sqe.opcode = IORING_OP_READV;
+	  sqe.addr = reinterpret_cast<std::uint64_t>(&_iovecs[index]);
+	  sqe.len = 1;
+	}
+	_sq_array[slot] = slot;
+	__atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	if(enter(_ring, 1, 0) < 0) {
+	  /* the kernel didn't take it: take it back, and read it here */
+	  __atomic_store_n(_sq_tail, tail, __ATOMIC_RELEASE);
+	  read_now(index, from);
+	}
+	return;
+      }
+#endif
+      read_now(index, from);
+    }
+
+    std::size_t complete(std::ptrdiff_t &result) {
+      if( !_done.empty() ) {
+	std::size_t index = _done.front().first;
+	result = _done.front().second;
+	_done.pop_front();
+	return index;
+      }
+#ifdef GRAMMAR_HAVE_IO_URING
+      while(_ring >= 0) {
+	unsigned head = *_cq_head;
+	if( head == __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE) ) {
+	  enter(_ring, 0, 1);
+	  continue;
+	}
+	io_uring_cqe &cqe = _cqes[head & *_cq_mask];
+	std::size_t index = cqe.user_data;
+	result = cqe.res;
+	__atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+	return index;
+      }
+#endif
+      throw std::logic_error("UringSource::complete without a read submitted");
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,77 @@
+/**
+ * @file grammar/bench_construction.cpp
+ *
+ * Times building (DefineGrammar) and sinking (Parser::sink) generated grammars of increasing size, the way grammars
+ * generated from protocol specs are built: one command per message type, each a case of one big Branch, with gotos to
+ * labels defined further on.
+ *
+ * usage: bench_construction [largest number of commands, default 100000]
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "./grammar.hpp"
+
+using namespace std;
+using namespace grammar;
+
+/* number of rules in one command (label, scan, reduction, branch, post-branch, gotos) */
+static const int rules_per_command = 9;
+
+/**
+ * command i reads "c<i>:<field>;" then either ends the message or goes on to command i + 1
+ */
+static DefineGrammar command(int i, int n, size_t &fields) {
+  stringstream name, next, pattern;
+  name << "c" << i;
+  next << "c" << (i + 1) % n;
+  pattern << "^c" << i << ":";
+
+  return re( pattern.str() ).label( name.str() )
+    .re("([^;]*);").on_string( [&fields](const string &) { ++fields; }, 1 )
+    .branch( re("^>").go( next.str() )
+	     , otherwise().go("start") );
+}
+
+int main(int argc, char *argv[]) {
+  typedef chrono::steady_clock clock;
+  int largest = argc > 1 ? atoi(argv[1]) : 100000;
+  size_t fields = 0;
+
+  cout << "commands      rules   build (s)    sink (s)  us/rule" << endl;
+  for(int n = 1000; n <= largest; n *= 10) {
+    clock::time_point start = clock::now();
+
+    DefineGrammar rule;
+    rule.label("start").branch();
+    for(int i = 0; i < n; ++i)
+      rule.add_case( command(i, n, fields) );
+    rule.add_case( otherwise().error("unknown command: ") );
+    rule.go("start");
+
+    clock::time_point built = clock::now();
+    Parser parse;
+    parse.sink( move(rule) );
+    clock::time_point sunk = clock::now();
+
+    /* make sure it works */
+    stringstream input;
+    input << "c0:a;>c1:b;c" << n - 1 << ":z;";
+    parse( input.str() );
+
+    double build_s = chrono::duration<double>(built - start).count()
+      , sink_s = chrono::duration<double>(sunk - built).count();
+    long rules = long(n) * rules_per_command;
+    cout.width(8); cout << n;
+    cout.width(11); cout << rules;
+    cout.width(12); cout << build_s;
+    cout.width(12); cout << sink_s;
+    cout.width(9); cout << (build_s + sink_s) * 1e6 / rules << endl;
+  }
+  cout << "fields read: " << fields << endl;
+  return 0;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file grammar/bench_lines.cpp
+ *
+ * Times parsing generated log lines with one Parser, fed a line at a time, and with LineParallel on 1, 2, 4 ... up to
+ * one thread per core.
+ *
+ * usage: bench_lines [lines, default 500000]
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "./grammar.hpp"
+#include "./LineParallel.hpp"
+
+using namespace std;
+using namespace grammar;
+
+/**
+ * "<time> <level> <component>: key=value ..." and counts the fields.  The field loop ends at the end of the line.
+ */
+static DefineGrammar log_line(size_t &fields) {
+  return DefineGrammar().re("^(\\d+) (\\w+) (\\w+): ").thunk( [&fields]() { ++fields; } )
+    .label("field")
+    .branch( re("^\\s*(\\w+)=(\\w+)").on_string( [&fields](const string &) { ++fields; }, 2 ).go("field")
+	     , re("^\\s*$").ignore() );
+}
+
+int main(int argc, char *argv[]) {
+  typedef chrono::steady_clock clock;
+  size_t lines = argc > 1 ? atoi(argv[1]) : 500000;
+  const char *levels[] = { "INFO", "WARN", "DEBUG" };
+
+  string text;
+  for(size_t i = 0; i < lines; ++i) {
+    text += to_string(1000000 + i) + " " + levels[i % 3] + " worker" + to_string(i % 7) + ":";
+    for(size_t f = 0; f < 4 + i % 5; ++f) text += " key" + to_string(f) + "=value" + to_string(i * f % 1000);
+    text += "\n";
+  }
+
+  size_t fields = 0;
+  clock::time_point start = clock::now();
+  {
+    Parser parse;
+    parse.sink( log_line(fields) );
+    string line;
+    for(const char *p = text.data(), *end = p + text.size(); p < end; ) {
+      const char *newline = static_cast<const char*>( memchr(p, '\n', end - p) );
+      line.assign(p, newline);
+      parse.reset();
+      parse(line);
+      p = newline + 1;
+    }
+  }
+  double one = chrono::duration<double>(clock::now() - start).count();
+  size_t expected = fields;
+  cout << text.size() / 1e6 << " MB, " << lines << " lines, " << fields << " fields" << endl;
+  cout << "Parser           " << one << " s" << endl;
+
+  unsigned cores = thread::hardware_concurrency();
+  for(unsigned threads = 1; threads <= max(cores, 1u); threads *= 2) {
+    fields = 0;
+    LineParallel parse( [&fields]() { return log_line(fields); }, threads, LineParallel::checked );
+    start = clock::now();
+    parse(text);
+    double seconds = chrono::duration<double>(clock::now() - start).count();
+    cout << "LineParallel x" << threads << "   " << seconds << " s (" << one / seconds << "x)"
+	 << (fields == expected ? "" : " wrong field count") << endl;
+  }
+  return 0;
+}
@@ -0,0 +1,63 @@
+/**
+ * @file grammar/bench_many.cpp
+ *
+ * Times classifying many short field values (numbers, words, key=value pairs) one at a time (reset, then parse) and
+ * with Parser::parse_many, for several numbers of lanes.
+ *
+ * usage: bench_many [inputs, default 1000000]
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "./grammar.hpp"
+
+using namespace std;
+using namespace grammar;
+
+int main(int argc, char *argv[]) {
+  typedef chrono::steady_clock clock;
+  size_t count = argc > 1 ? atoi(argv[1]) : 1000000;
+
+  vector<string> inputs;
+  for(size_t i = 0; i < count; ++i)
+    switch(i % 4) {
+    case 0: inputs.push_back( to_string(i * 7919 % 100000) ); break;
+    case 1: inputs.push_back( "word" + string(1, 'a' + i % 26) ); break;
+    case 2: inputs.push_back( "key" + to_string(i % 100) + "=" + to_string(i) ); break;
+    default: inputs.push_back( "-" + to_string(i % 1000) + ".5" ); break;
+    }
+
+  size_t numbers = 0, words = 0, pairs = 0, other = 0;
+  Parser parse;
+  parse.sink( DefineGrammar()
+	      .branch( re("^[0-9]+$").thunk( [&]() { ++numbers; } )
+		       , re("^[a-z]+$").thunk( [&]() { ++words; } )
+		       , re("^(\\w+)=(\\w*)$").thunk( [&]() { ++pairs; } )
+		       , otherwise().re(".*").thunk( [&]() { ++other; } ) ) );
+
+  clock::time_point start = clock::now();
+  for(auto &s : inputs) {
+    string input(s);
+    parse.reset();
+    parse(input);
+  }
+  double one = chrono::duration<double>(clock::now() - start).count();
+  size_t expected = numbers + words + pairs + other;
+  cout << count << " inputs: " << numbers << " numbers, " << words << " words, " << pairs << " pairs, " << other
+       << " other" << endl;
+  cout << "one at a time     " << one << " s" << endl;
+
+  for(size_t lanes = 1; lanes <= 16; lanes *= 2) {
+    numbers = words = pairs = other = 0;
+    start = clock::now();
+    parse.parse_many(inputs.begin(), inputs.end(), lanes);
+    double seconds = chrono::duration<double>(clock::now() - start).count();
+    cout << "parse_many x" << lanes << (lanes < 10 ? "     " : "    ") << seconds << " s (" << one / seconds << "x)"
+	 << (numbers + words + pairs + other == expected ? "" : " wrong count") << endl;
+  }
+  return 0;
+}
@@ -0,0 +1,96 @@
+/**
+ * @file grammar/bench_reactor.cpp
+ *
+ * Times one Reactor thread parsing many local socket streams at once.  Each round writes one piece to every stream,
+ * ending in the middle of a token, then runs the reactor until every message completed so far has been parsed.
+ *
+ * usage: bench_reactor [streams, default 10000] [rounds, default 100]
+ *
+ * Each stream takes two descriptors, so the number of streams is cut down to fit the process's limit on open files.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "./grammar.hpp"
+#include "./Reactor.hpp"
+
+using namespace std;
+using namespace grammar;
+
+int main(int argc, char *argv[]) {
+  typedef chrono::steady_clock clock;
+  size_t streams = argc > 1 ? atoi(argv[1]) : 10000
+    , rounds = argc > 2 ? atoi(argv[2]) : 100;
+
+  rlimit files;
+  getrlimit(RLIMIT_NOFILE, &files);
+  files.rlim_cur = files.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &files);
+  getrlimit(RLIMIT_NOFILE, &files);
+  if(files.rlim_cur != RLIM_INFINITY && streams > (files.rlim_cur - 32) / 2) {
+    streams = (files.rlim_cur - 32) / 2;
+    cout << "open file limit is " << files.rlim_cur << ", using " << streams << " streams" << endl;
+  }
+
+  GrammarSlot slot;
+  Reactor reactor(slot, 1024, 256);
+  vector<size_t> messages(streams, 0);
+  size_t parsed = 0, closed = 0, errors = 0;
+
+  slot.publish( DefineGrammar().label("message")
+		.re("^\\s*(\\w+)=(\\w+);").thunk( [&]() { ++messages[reactor.current()]; ++parsed; } )
+		.go("message") );
+  reactor.on_close( [&](Reactor::StreamId) { ++closed; } );
+  reactor.on_error( [&](Reactor::StreamId, const exception &e) { ++errors; cerr << e.what() << endl; } );
+
+  vector<int> writers;
+  for(size_t i = 0; i < streams; ++i) {
+    int pair[2];
+    if( socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0 ) {
+      cerr << "socketpair failed after " << i << " streams" << endl;
+      return 1;
+    }
+    reactor.add(pair[0]);
+    writers.push_back(pair[1]);
+  }
+
+  auto put = [](int fd, const string &s) {
+    if( write(fd, s.data(), s.size()) != ssize_t(s.size()) ) {
+      cerr << "short write" << endl;
+      exit(1);
+    }
+  };
+
+  clock::time_point start = clock::now();
+  size_t bytes = 0, turns = 0;
+  for(size_t i = 0; i < streams; ++i) put(writers[i], "key0");
+
+  for(size_t r = 0; r < rounds; ++r) {
+    string piece = "=value" + to_string(r) + ";\nkey" + to_string(r + 1);
+    for(size_t i = 0; i < streams; ++i) put(writers[i], piece);
+    bytes += piece.size() * streams;
+
+    while(parsed < streams * (r + 1)) turns += reactor.run_once(100);
+  }
+
+  for(int fd : writers) close(fd);
+  while( reactor.size() ) turns += reactor.run_once(100);
+  double seconds = chrono::duration<double>(clock::now() - start).count();
+
+  size_t short_streams = 0;
+  for(size_t n : messages) if(n != rounds) ++short_streams;
+
+  cout << "streams " << streams << ", rounds " << rounds << ", messages " << parsed
+       << ", turns " << turns << ", closed " << closed << ", errors " << errors
+       << ", streams missing messages " << short_streams << endl;
+  cout << seconds << " s, " << parsed / seconds << " messages/s, " << bytes / seconds / 1e6 << " MB/s" << endl;
+  return short_streams || errors ? 1 : 0;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file grammar/bench_read.cpp
+ *
+ * Times reading the lines of one file: std::getline, mmap, InputPipeline reading an istream, and InputPipeline with a
+ * UringSource (io_uring, or pread where there isn't one), with and without O_DIRECT.  Only the reading and splitting
+ * into lines is timed, not parsing.
+ *
+ * usage: bench_read [megabytes, default 256] [file, default bench_read.txt (written first)]
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "./Uring.hpp"
+
+using namespace std;
+using namespace grammar;
+
+int main(int argc, char *argv[]) {
+  typedef chrono::steady_clock clock;
+  size_t megabytes = argc > 1 ? atoi(argv[1]) : 256;
+  string path = argc > 2 ? argv[2] : "bench_read.txt";
+
+  {
+    ofstream out(path.c_str(), ios::binary);
+    string line;
+    for(size_t written = 0, i = 0; written < megabytes << 20; written += line.size(), ++i) {
+      line = "<record id=\"" + to_string(i) + "\"><name>item " + to_string(i * 7919 % 100000) + "</name></record>\n";
+      out << line;
+    }
+  }
+
+  size_t expected = 0;
+  auto time = [&](const string &name, const function<size_t ()> &read_lines) {
+    clock::time_point start = clock::now();
+    size_t characters = read_lines();
+    double seconds = chrono::duration<double>(clock::now() - start).count();
+    if(!expected) expected = characters;
+    cout << left << setw(46) << name << seconds << " s, " << characters / seconds / 1e6 << " MB/s"
+	 << (characters == expected ? "" : " wrong count") << endl;
+  };
+
+  /* characters of each line and its newline; counting them keeps the lines from being optimized away */
+  time("std::getline", [&]() {
+      ifstream in(path.c_str(), ios::binary);
+      string line;
+      size_t characters = 0;
+      while( getline(in, line) ) characters += line.size() + 1;
+      return characters;
+    });
+
+  time("mmap", [&]() {
+      int fd = open(path.c_str(), O_RDONLY);
+      struct stat st;
+      fstat(fd, &st);
+      const char *data = static_cast<const char*>( mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) );
+      madvise(const_cast<char*>(data), st.st_size, MADV_SEQUENTIAL);
+      string line;
+      size_t characters = 0;
+      for(const char *p = data, *end = data + st.st_size; p < end; ) {
+	const char *newline = static_cast<const char*>( memchr(p, '\n', end - p) );
+	if(!newline) newline = end;
+	line.assign(p, newline);
+	characters += line.size() + 1;
+	p = newline + 1;
+      }
+      munmap(const_cast<char*>(data), st.st_size);
+      close(fd);
+      return characters;
+    });
+
+  time("InputPipeline(istream)", [&]() {
+      ifstream in(path.c_str(), ios::binary);
+      InputPipeline read(in);
+      size_t characters = 0;
+      read.foreach_line( [&](string &line) { characters += line.size() + 1; } );
+      return characters - 1;	/* the empty line after the last newline */
+    });
+
+  for(int direct = 0; direct < 2; ++direct) {
+    UringSource source(path, direct);
+    InputPipeline read(source, 1 << 20, 8);
+    string name = string("InputPipeline(") + (source.uring() ? "io_uring" : "pread")
+      + (source.registered() ? ", registered" : "") + (source.direct() ? ", O_DIRECT" : "") + ")";
+    time(name, [&]() {
+	size_t characters = 0;
+	read.foreach_line( [&](string &line) { characters += line.size() + 1; } );
+	return characters - 1;
+      });
+  }
+
+  remove( path.c_str() );
+  return 0;
+}
@@ -1,2 +1,9 @@
-CXX= g++ -ggdb -Wall -std=c++11 -lboost_regex 
+CXX= g++ -ggdb -Wall -std=c++11
+LDLIBS= -lboost_regex -lz
 #CXX= clang++ -ggdb -Wall -std=c++11 -stdlib=libc++ 
+
+# make ZSTD=1 to read zstd-compressed input as well (see Decompress.hpp)
+ifdef ZSTD
+CXX+= -DGRAMMAR_HAVE_ZSTD
+LDLIBS+= -lzstd
+endif
@@ -18,6 +18,9 @@
 #include "Branch.hpp"
 #include "Until.hpp"
 #include "Parser.hpp"
+#include "GrammarSet.hpp"
+#include "Tokens.hpp"
+#include "Columns.hpp"
 #include "Rule.hpp"
 #include "NamelessGrammar.hpp"
 #include "Reduce.hpp"
@@ -0,0 +1,53 @@
+/**
+ * @file grammar/test_alloc.cpp
+ *
+ * Checks that a warmed up Parser doesn't allocate per token, by counting calls to a replaced global operator new.  It's
+ * a program of its own so the replacement doesn't reach test_grammar, whose threads it would race on and whose
+ * sanitizer builds it would break.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+
+#include "./grammar.hpp"
+
+using namespace std;
+
+/* counts heap allocations (this program only has the one thread) */
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+  ++allocations;
+  void *p = malloc(size ? size : 1);
+  if(!p) throw bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
+int main() {
+  using namespace grammar;
+
+  cout << "No allocation per token once warmed up:\n" << endl;
+  size_t characters = 0;
+  Parser parse;
+  parse.sink( DefineGrammar().label("field")
+	      .branch( re("^\\s*(\\w+)=(\\w+);").on_string( [&](const string &s) { characters += s.size(); }, 2 )
+		       .go("field")
+		       , re("^\\s*#(.*)").on_string( [&](const string &s) { characters += s.size(); }, 1 )
+		       .go("field") ) );
+  string line;
+  size_t warm = 0;
+  for(int round = 0; round < 2; ++round) {
+    size_t before = allocations;
+    for(int i = 0; i < 1000; ++i) {
+      line = "first_key=a_value_longer_than_sso; b=2; another_key=another_long_value; # a comment, also long";
+      parse(line);
+    }
+    warm = allocations - before;
+    cout << (round ? "warm: " : "cold: ") << (warm ? "allocated" : "no allocations") << endl;
+  }
+  return warm ? 1 : 0;
+}
@@ -0,0 +1,70 @@
+/**
+ * @file grammar/test_async.cpp
+ *
+ * Feeds parsers from pipes through the coroutine driver (needs -std=c++20).  The writer splits the input in the middle
+ * of tokens, to show the parsers don't need whole lines.  The last stream's grammar has no delimiter after a word, so
+ * only waiting for the rest of a word cut at the end of a chunk keeps it whole.
+ */
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "./grammar.hpp"
+#include "./AsyncParser.hpp"
+
+using namespace std;
+using namespace grammar;
+
+int main() {
+  EventLoop loop;
+  const int streams = 3;
+  vector<unique_ptr<Parser> > parsers;
+  vector<unique_ptr<FdSource> > sources;
+  vector<ParseTask> tasks;
+  int pipes[streams][2];
+  vector<vector<string> > words(streams);
+
+  for(int i = 0; i < streams; ++i) {
+    if( pipe(pipes[i]) < 0 ) return 1;
+    fcntl(pipes[i][0], F_SETFL, O_NONBLOCK);
+
+    parsers.emplace_back(new Parser);
+    parsers.back()->sink( DefineGrammar().label("word")
+			  .re(i < 2 ? "^\\s*(\\w+);" : "^\\W*(\\w+)")
+			  .on_string( [&words, i](const string &s) { words[i].push_back(s); }, 1 )
+			  .go("word") );
+    sources.emplace_back( new FdSource(pipes[i][0], loop) );
+    tasks.push_back( parse_async(*parsers.back(), *sources.back()) );
+  }
+
+  /* every piece is written separately, so each arrives as its own chunk */
+  thread writer([&]() {
+      const char *pieces[] = { "alp", "ha; be", "ta;\ngam", "ma; del", "ta;" };
+      for(auto piece : pieces)
+	for(int i = 0; i < streams; ++i) {
+	  ssize_t n = write(pipes[i][1], piece, strlen(piece));
+	  (void)n;
+	  this_thread::sleep_for( chrono::milliseconds(5) );
+	}
+      for(int i = 0; i < streams; ++i) close(pipes[i][1]);
+    });
+
+  cout << "waiting: " << loop.waiting() << endl;
+  loop.run();
+  writer.join();
+
+  for(int i = 0; i < streams; ++i) {
+    tasks[i].get();
+    cout << "stream " << i << (tasks[i].done() ? " (done):" : ":");
+    for(auto &w : words[i]) cout << " " << w;
+    cout << endl;
+    close(pipes[i][0]);
+  }
+  return 0;
+}
@@ -6,12 +6,25 @@
  * Some simple test routines for the grammar (now using regexs)
  */
 
+#include <atomic>
+#include <fstream>   // for files
 #include <iostream>  // for cout and friends
 #include <sstream>   // for string streams
 #include <string>    // for the STL string class
+#include <thread>
 
 #define DEBUG_GRAMMAR_BRANCH
 #include "./grammar.hpp"
+#include "./StaticGrammar.hpp"
+#include "./Reactor.hpp"
+#include "./LineParallel.hpp"
+#include "./Speculative.hpp"
+#include "./Incremental.hpp"
+#include "./Pipeline.hpp"
+#include "./Uring.hpp"
+#include "./Decompress.hpp"
+
+#include <sys/socket.h>
 
 using namespace std ;     // to eliminate the need for std::
 
@@ -114,5 +127,599 @@ int main( int argc, char* argv[] ) {
 	     , [&](const string& s) { parse(s);});
   }
 
+  cout << "\n\nCases sharing a prefix (factored into one test):\n" << endl;
+  {
+    Parser parse;
+    DefineGrammar rule;
+    rule.label("command")
+      .branch( re("^\\s*add\\s+(\\w+)").on_string( [&](const string &str) {
+	    cout << "add: " << str << endl;
+	  }, 1)
+	, re("^\\s*adjust\\s+(\\w+)").on_string( [&](const string &str) {
+	    cout << "adjust: " << str << endl;
+	  }, 1)
+	, re("^\\s*remove\\s+(\\w+)").on_string( [&](const string &str) {
+	    cout << "remove: " << str << endl;
+	  }, 1)
+	, re(".*").on_string( [&](const string &str) {
+	    cout << "unknown: " << str << endl;
+	  }, 0)
+	).go("command");
+    parse.sink( move(rule) );
+    parse.print();
+    cout << endl;
+
+    parse("  add element");
+    parse("adjust root");
+    parse("   remove student");
+    parse("ad hoc");
+  }
+
+  cout << "\n\nReordering cases by how often they're chosen:\n" << endl;
+  {
+    auto build = [](Parser &parse) {
+      DefineGrammar rule;
+      rule.label("word")
+	.branch( re("^\\s+").ignore()
+		 , re("^#.*").ignore()
+		 , re("^[0-9]+").ignore()
+		 , re("^[a-z]+").ignore()
+		 , otherwise().error("unexpected character: ") )
+	.go("word");
+      parse.sink( move(rule) );
+    };
+    stringstream profile;
+
+    {
+      Parser parse;
+      build(parse);
+      parse("the quick brown fox jumps over 2 lazy dogs");
+      parse.reorder_cases();
+      parse.print();
+      parse.save_profile(profile);
+    }
+    cout << "\nprofile: " << profile.str();
+
+    Parser parse;
+    build(parse);
+    parse.load_profile(profile);
+    parse.print();
+    cout << endl;
+  }
+
+  cout << "\n\nLoops which don't consume input:\n" << endl;
+  {
+    Parser parse;
+    DefineGrammar rule;
+    rule.label("x").branch( re("a").ignore()
+			    , re("").go("x") );
+    try {
+      parse.sink( move(rule) );
+      cout << "sank a grammar with a loop" << endl;
+    } catch(std::runtime_error &e) {
+      cout << e.what() << endl;
+    }
+  }
+
+  {
+    Parser parse;
+    DefineGrammar rule;
+    /* sink can't see through an If, so this one is caught while parsing */
+    rule.label("y")._if( [](){ return true; }, DefineGrammar().go("y") );
+    parse.sink( move(rule) );
+    parse.set_stall_limit(1000);
+    try {
+      parse("abc");
+      cout << "parse returned" << endl;
+    } catch(std::runtime_error &e) {
+      cout << e.what() << endl;
+    }
+  }
+
+  cout << "\n\nParsing within a budget:\n" << endl;
+  {
+    Parser parse;
+    parse.sink( DefineGrammar().label("w")
+		.re("^\\s*(\\w+)").on_string( [](const string &s) { cout << s << " "; }, 1 ).go("w") );
+
+    string input("one two three four five");
+    ParseStatus status;
+    /* each word takes three rules (scan, reduction, goto) */
+    while( (status = parse(input, Budget().steps(6))) == ParseStatus::exhausted )
+      cout << "| ";
+    cout << endl;
+
+    std::atomic<bool> cancel(true);
+    input = "six seven";
+    status = parse(input, Budget().cancel_on(cancel));
+    cout << "cancelled: " << (status == ParseStatus::cancelled) << ", left |" << input << "|" << endl;
+  }
+
+  cout << "\n\nIterating over reductions:\n" << endl;
+  {
+    Parser parse;
+    parse.sink( DefineGrammar().label("pair")
+		.re("^\\s*(\\w+)=").ignore()
+		.label("value").re("^(\\w+)").ignore()
+		.go("pair") );
+
+    string input("a=1 b=22 c=333 d=4444");
+    for(auto tok : parse.tokens(input)) {
+      cout << *tok.label << " " << tok.rule << ": ";
+      cout.write( tok.data(1), tok.length(1) ) << endl;
+      if(*tok.label == "value" && tok.length(1) == 3) break;
+    }
+    cout << "left |" << input << "|" << endl;
+  }
+
+  cout << "\n\nReductions applied in batches:\n" << endl;
+  {
+    Parser parse;
+    int reduced = 0;
+    parse.sink( DefineGrammar().label("w")
+		._if( [&]() { cout << "(" << reduced << " reduced) "; return false; }, DefineGrammar() )
+		.re("^\\s*(\\w+)").on_string( [&](const string &s) { ++reduced; cout << s << " "; }, 1 )
+		.branch( re("^\\s*!").error("stopped at: ")
+			 , otherwise().go("w") ) );
+    parse.batch_reductions(true);
+
+    parse("one two three");
+    cout << endl;
+    try {
+      parse("four five ! six");
+    } catch(SyntaxError &e) {
+      cout << endl << e.what() << endl;
+    }
+  }
+
+  cout << "\n\nMany short inputs at once:\n" << endl;
+  {
+    Parser parse;
+    vector<string> kinds(5);
+    parse.sink( DefineGrammar()
+		.branch( re("^[0-9]+$").thunk( [&]() { kinds[parse.input_index()] = "number"; } )
+			 , re("^\\w+=\\w+$").thunk( [&]() { kinds[parse.input_index()] = "pair"; } )
+			 , otherwise().re(".*").thunk( [&]() { kinds[parse.input_index()] = "other"; } ) ) );
+
+    const char *inputs[] = { "42", "a=b", "x y", "7", "k=12" };
+    parse.parse_many(inputs, inputs + 5, 2);
+    for(int i = 0; i < 5; ++i) cout << inputs[i] << ": " << kinds[i] << endl;
+  }
+
+  cout << "\n\nLines parsed on several threads:\n" << endl;
+  {
+    string lines;
+    for(int i = 0; i < 12; ++i) lines += "k" + to_string(i) + "=v" + to_string(i * i) + "\n";
+
+    auto records = []() {
+      return DefineGrammar().label("record")
+	.re("^(\\w+)=(\\w+)").on_match( [](Match &m) { cout << m[1] << " -> " << m[2] << "  "; } )
+	.go("record");
+    };
+    LineParallel parse(records, 3, LineParallel::checked, 16);
+    parse(lines);
+    cout << endl;
+
+    /* a field loop which ends at the end of the line */
+    LineParallel fields( []() {
+	return DefineGrammar().re("^(\\w+):").on_string( [](const string &s) { cout << s << ":"; }, 1 )
+	  .label("field")
+	  .branch( re("^\\s*(\\w+)").on_string( [](const string &s) { cout << " " << s; }, 1 ).go("field")
+		   , re("^\\s*$").thunk( []() { cout << endl; } ) );
+      }, 2, LineParallel::checked );
+    fields("a: x y\nb: z\n");
+
+    LineParallel blocks( []() { return DefineGrammar().re("^begin").label("body").re("^\\s*end").ignore().go("body"); }
+			 , 2, LineParallel::checked );
+    try {
+      blocks("begin\nend\n");
+    } catch(std::runtime_error &e) {
+      cout << e.what() << endl;
+    }
+  }
+
+  cout << "\n\nOne document parsed speculatively in chunks:\n" << endl;
+  {
+    auto show = [](const string &what) {
+      return [=](const string &s) { cout << what << " " << s << endl; };
+    };
+    auto document = [&]() {
+      return DefineGrammar().label("line")
+	.branch( re("^<(\\w+)>").on_string( show("tag"), 1 )
+		 , re("^\\{").label("quoted")
+		 .branch( re("^\\}").go("line")
+			  , re("^(.+)").on_string( show("quoted"), 1 ).go("quoted") )
+		 , re("^(.+)").on_string( show("text"), 1 ) )
+	.go("line");
+    };
+    /* each chunk starts at a tag, guessed to be outside braces; the one starting <b> isn't */
+    SpeculativeParser parse(document, "line", [](const char *begin, const char *) { return *begin == '<'; }, 2, 4);
+    int lines = 0;
+    parse.on_line( [&]() { ++lines; } );
+    parse("<a>\ntext\n{\n<b>\n}\n<c>\nmore\n");
+    cout << lines << " lines, " << parse.reparsed() << " chunk parsed again" << endl;
+  }
+
+  cout << "\n\nCheckpoint and restore:\n" << endl;
+  {
+    int lines = 0;
+    auto document = [&]() {
+      return DefineGrammar().label("line")
+	.branch( re("^<(\\w+)>").on_string( [&](const string &s) { cout << lines << ": tag " << s << endl; }, 1 )
+		 , re("^\\{").label("quoted")
+		 .branch( re("^\\}").go("line")
+			  , re("^(.+)").on_string( [&](const string &s) { cout << lines << ": quoted " << s << endl; }, 1 )
+			  .go("quoted") )
+		 , re("^(.+)").ignore() )
+	.go("line");
+    };
+    string text[] = { "<a>", "{", "one", "two", "}", "<b>" };
+    stringstream saved;
+    {
+      Parser parse;
+      parse.sink( document() );
+      for(int i = 0; i < 3; ++i) { parse(text[i]); ++lines; }
+      /* the job dies here, inside the braces */
+      parse.save_checkpoint(saved, 3, [&](ostream &out) { checkpoint::write(out, lines); });
+    }
+    lines = 0;
+    Parser parse;
+    parse.sink( document() );
+    uint64_t offset = parse.restore_checkpoint(saved, [&](istream &in) { lines = checkpoint::read_number(in); });
+    cout << "restored at line " << offset << endl;
+    for(int i = offset; i < 6; ++i) { parse(text[i]); ++lines; }
+  }
+
+  cout << "\n\nIncremental re-parse of an edited buffer:\n" << endl;
+  {
+    auto config = []() {
+      return DefineGrammar().label("line")
+	.branch( re("^\\[(\\w+)\\]").on_string( [](const string &) {}, 1 )
+		 , re("^\"\"\"").label("block")
+		 .branch( re("^\"\"\"").go("line")
+			  , re("^(.+)").on_string( [](const string &) {}, 1 ).go("block") )
+		 , re("^(\\w+)=(\\w*)").on_string( [](const string &) {}, 2 )
+		 , re("^(.+)").ignore() )
+	.go("line");
+    };
+    string text;
+    for(int i = 0; i < 200; ++i) text += i % 20 ? "key" + to_string(i) + "=value\n" : "[section" + to_string(i) + "]\n";
+
+    IncrementalParser parse(config(), 64);
+    parse.set_text(text);
+    auto same_as_from_scratch = [&]() {
+      IncrementalParser scratch(config(), 64);
+      scratch.set_text( parse.text() );
+      const TokenColumns &a = parse.tokens(), &b = scratch.tokens();
+      return a.offset == b.offset && a.length == b.length && a.rule == b.rule && a.capture == b.capture;
+    };
+    auto report = [&](const string &what) {
+      cout << dec << what << ": re-parsed " << parse.reparsed() << " of " << parse.text().size() << " characters, "
+	   << parse.tokens().size() << " records, " << (same_as_from_scratch() ? "same" : "NOT the same")
+	   << " as parsing from scratch" << endl;
+    };
+    parse.edit( text.find("key105=value") + 7, 5, "changed" );
+    report("change a value");
+    /* an opening quote: the rest of the text is in a block, so the old parse never holds again */
+    parse.edit( parse.text().find("key150"), 0, "\"\"\"\n" );
+    report("open a block");
+    parse.edit( parse.text().find("key170"), 0, "\"\"\"\n" );
+    report("close it");
+    parse.edit( 0, 0, "x=1\n" );
+    report("add a line at the top");
+  }
+
+  cout << "\n\nReading on a thread of its own:\n" << endl;
+  {
+    /* 16 character buffers, so lines are split between them */
+    stringstream in("<a>\n  <b>a line longer than a buffer</b>\n</a>\nno newline");
+    InputPipeline read(in, 16, 2);
+    read.foreach_line( [&](string &line) { cout << read.offset() << " |" << line << "|" << endl; } );
+  }
+
+  cout << "\n\nReading a file with io_uring (or pread):\n" << endl;
+  {
+    const char *path = "test_uring.txt";
+    string text;
+    for(int i = 0; i < 1000; ++i) text += "line " + to_string(i) + "\n";
+    ofstream(path) << text;
+
+    UringSource source(path);
+    InputPipeline read(source, 4096, 3);
+    string lines;
+    read.foreach_line( [&](string &line) { lines += line + "\n"; } );
+    cout << (lines == text + "\n" ? "every line read" : "lines missing") << endl;
+    remove(path);
+  }
+
+  cout << "\n\nReads which come back short:\n" << endl;
+  {
+    /* hands back at most 1000 characters a read, as a pipe or a signal might */
+    struct ShortReads : AsyncSource {
+      string text;
+      size_t offset = 0, size = 0;
+      vector<char*> buffers;
+      vector<size_t> starts;
+      deque< pair<size_t, ptrdiff_t> > done;
+
+      void attach(char *const *b, size_t count, size_t s) {
+	buffers.assign(b, b + count);
+	starts.assign(count, 0);
+	size = s;
+      }
+      void submit(size_t index, size_t from) {
+	if(!from) {
+	  starts[index] = offset;
+	  offset += size;
+	}
+	size_t at = min(text.size(), starts[index] + from), n = min( min<size_t>(1000, size - from), text.size() - at );
+	memcpy(buffers[index] + from, text.data() + at, n);
+	done.push_back( make_pair(index, ptrdiff_t(n)) );
+      }
+      size_t complete(ptrdiff_t &result) {
+	size_t index = done.front().first;
+	result = done.front().second;
+	done.pop_front();
+	return index;
+      }
+    } source;
+    for(int i = 0; i < 1000; ++i) source.text += "line " + to_string(i) + "\n";
+
+    InputPipeline read(source, 4096, 3);
+    string lines;
+    read.foreach_line( [&](string &line) { lines += line + "\n"; } );
+    cout << (lines == source.text + "\n" ? "every line read" : "lines missing") << endl;
+  }
+
+  cout << "\n\nReading gzip-compressed input:\n" << endl;
+  {
+    string text, compressed;
+    for(int i = 0; i < 1000; ++i) text += "line " + to_string(i) + "\n";
+
+    /* two gzip members, as cat a.gz b.gz makes */
+    for(auto half : { text.substr(0, 3000), text.substr(3000) }) {
+      z_stream z;
+      memset(&z, 0, sizeof(z));
+      deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+      vector<char> out( deflateBound(&z, half.size()) );
+      z.next_in = (Bytef*)half.data();
+      z.avail_in = half.size();
+      z.next_out = (Bytef*)out.data();
+      z.avail_out = out.size();
+      deflate(&z, Z_FINISH);
+      compressed.append(out.data(), out.size() - z.avail_out);
+      deflateEnd(&z);
+    }
+
+    istringstream in(compressed);
+    Compression format = detect_compression(in);
+    cout << (format == Compression::gzip ? "gzip" : "not gzip") << endl;
+    DecompressSource inflate(in, format, 256);
+    InputPipeline read( [&](char *data, size_t size) { return inflate(data, size); }, 4096, 3 );
+    string lines;
+    read.foreach_line( [&](string &line) { lines += line + "\n"; } );
+    cout << (lines == text + "\n" ? "every line read" : "lines missing") << endl;
+
+    istringstream cut( compressed.substr(0, compressed.size() / 2) );
+    DecompressSource cut_inflate(cut, Compression::gzip);
+    char buffer[4096];
+    try {
+      while( cut_inflate(buffer, sizeof(buffer)) );
+    } catch(runtime_error &e) {
+      cout << e.what() << endl;
+    }
+  }
+
+  cout << "\n\nReductions as columns:\n" << endl;
+  {
+    Parser parse;
+    parse.sink( DefineGrammar().label("pair")
+		.re("^\\s*(\\w+)=").on_string( [](const string &) { cout << "not called" << endl; }, 1 )
+		.re("^(\\w+);").ignore()
+		.go("pair") );
+
+    const char *chunks[] = { "a=1; bb=22; c", "cc=333;" };
+    string stream, buffer;
+    TokenColumns columns;
+    for(auto chunk : chunks) {
+      stream += chunk;
+      buffer += chunk;
+      parse.push(buffer, columns);
+    }
+    parse.push(buffer, columns, false);
+    for(size_t i = 0; i < columns.size(); ++i)
+      cout << dec << columns.rule[i] << " [" << columns.capture[i] << "] " << columns.offset[i] << "+" << columns.length[i]
+	   << " |" << stream.substr(columns.offset[i], columns.length[i]) << "|" << endl;
+  }
+
+  cout << "\n\nMany streams on one thread:\n" << endl;
+  {
+    GrammarSlot slot;
+    Reactor reactor(slot, 16);
+    slot.publish( DefineGrammar().label("pair")
+		  .re("^\\s*(\\w+=\\w+);").on_string( [&](const string &s) {
+		      cout << "stream " << reactor.current() << ": " << s << endl;
+		    }, 1 )
+		  .go("pair") );
+    reactor.on_close( [](Reactor::StreamId id) { cout << "closed " << id << endl; } );
+    reactor.on_error( [](Reactor::StreamId id, const exception &e) { cout << id << ": " << e.what() << endl; } );
+
+    const char *inputs[] = { "a=1; b=2;", "c=3; no_delimiter_within_sixteen" };
+    for(auto in : inputs) {
+      int pair[2];
+      if( socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0 ) break;
+      reactor.add(pair[0]);
+      ssize_t n = write(pair[1], in, strlen(in));
+      (void)n;
+      close(pair[1]);
+    }
+    reactor.run();
+  }
+
+  cout << "\n\nA word split between two sends:\n" << endl;
+  {
+    GrammarSlot slot;
+    Reactor reactor(slot, 64, 8);	/* read 8 characters at a time */
+    slot.publish( DefineGrammar().label("word")
+		  .re("^\\s*(\\w+)").on_string( [](const string &s) { cout << "|" << s << "|" << endl; }, 1 )
+		  .go("word") );
+
+    int pair[2];
+    if( socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0 ) {
+      reactor.add(pair[0]);
+      const char *sends[] = { "hello wo", "rld ok" };
+      for(auto s : sends) {
+	ssize_t n = send(pair[1], s, strlen(s), 0);
+	(void)n;
+      }
+      close(pair[1]);
+      reactor.run();
+    }
+  }
+
+  cout << "\n\nChoosing among grammars by the leading token:\n" << endl;
+  {
+    GrammarSet set;
+    set.add("get", re("^GET\\s+(\\S+)").on_string( [](const string &s) { cout << "get " << s << endl; }, 1 ));
+    set.add("put", re("^PUT\\s+(\\S+)\\s+").on_string( [](const string &s) { cout << "put " << s << endl; }, 1 )
+	    .re("(.*)").on_string( [](const string &s) { cout << "  value " << s << endl; }, 1 ));
+    set.add("post", DefineGrammar().label("post")
+	    .branch( re("^POST\\s+(\\S+)").on_string( [](const string &s) { cout << "post " << s << endl; }, 1 )
+		     , re("^PATCH\\s+(\\S+)").on_string( [](const string &s) { cout << "patch " << s << endl; }, 1 ) ));
+
+    set("GET /index");
+    cout << "selected " << set.selected_name() << endl;
+    set.reset();
+    set("PUT /key some value");
+    set.reset();
+    set("PATCH /x");
+    cout << "selected " << set.selected_name() << endl;
+    set.reset();
+    try {
+      set("DELETE /x");
+    } catch(SyntaxError &e) {
+      cout << e.what() << endl;
+    }
+  }
+
+  cout << "\n\nReplacing a grammar while it's in use:\n" << endl;
+  {
+    auto version = [](const string &name) {
+      return DefineGrammar().label("line")
+	.re("^(\\w+)\\s*").on_string( [=](const string &s) { cout << name << ": " << s << endl; }, 1 )
+	.go("line");
+    };
+    GrammarSlot slot;
+    slot.publish( version("v1") );
+
+    Parser at_reset, at_label;
+    at_reset.attach(slot);
+    at_label.attach(slot, "line");
+
+    at_reset("one");
+    at_label("one");
+    slot.publish( version("v2") );
+    at_reset("two");		/* keeps v1 until reset */
+    at_label("two");		/* changes over when it next reaches "line" */
+    at_reset.reset();
+    at_reset("three");
+    at_label("three");
+  }
+
+  cout << "\n\nOne grammar shared by Parsers on two threads:\n" << endl;
+  {
+    atomic<size_t> as(0), bs(0);
+    GrammarSlot slot;
+    slot.publish( DefineGrammar().label("ab")
+		  .branch( re("^a").thunk( [&]() { ++as; } ).go("ab")
+			   , re("^b").thunk( [&]() { ++bs; } ).go("ab") ) );
+
+    auto work = [&]() {
+      Parser parse;
+      parse.attach(slot);
+      for(int i = 0; i < 1000; ++i) parse("ababab");
+    };
+    thread one(work), two(work);
+    one.join();
+    two.join();
+
+    Parser counts;
+    counts.attach(slot);
+    stringstream profile;
+    counts.save_profile(profile);
+    cout << dec << as << " a, " << bs << " b; profile: " << profile.str();
+  }
+
+  cout << "\n\nScanners without a regex (and their regex equivalents):\n" << endl;
+  {
+    auto show = [](const string &what) {
+      return [=](const string &s) { cout << what << " |" << s << "|" << endl; };
+    };
+    auto tags = [&](DefineGrammar &&open, DefineGrammar &&name, DefineGrammar &&text, DefineGrammar &&close) {
+      Parser parse;
+      parse.sink( DefineGrammar().label("tag")
+		  .append( move(open) ).on_string( show("open") )
+		  .append( move(name) ).on_string( show(" name") )
+		  .append( move(text) ).on_string( show(" text") )
+		  .branch( move(close).on_string( show(" close") ).go("tag")
+			   , re(".").go("tag") ) );
+      parse("  <b>bold</b> <i>it</i>");
+    };
+
+    tags( lit("<"), take_while(::isalpha), skip_to('<'), lit("</") );
+    cout << "--" << endl;
+    tags( re("<"), re("^[[:alpha:]]*"), re("^[^<]*(?=<)"), re("</") );
+    cout << "--" << endl;
+
+    Parser parse;
+    parse.sink( DefineGrammar().label("n").one_of("0123456789").on_string( show("digit") ).go("n") );
+    parse("a1b22");
+  }
+
+  cout << "\n\nPatterns compile on first use:\n" << endl;
+  {
+    Pattern used("^a+"), unused("^b+");
+    Match m;
+    cout << "before: " << used.compiledP() << unused.compiledP() << endl;
+    used.find( m.set_input("aab") );
+    cout << "after: " << used.compiledP() << unused.compiledP() << " matched " << m.str() << endl;
+  }
+
+  cout << "\n\nSame grammars built with the fixed (compile time) DSL:\n" << endl;
+  {
+    namespace fx = grammar::fixed; /* the fixed vocabulary shadows grammar's */
+    struct begin;
+
+    auto rule = fx::label<begin>().branch( fx::re_i("(.*quit.*)").on_string(match)
+					   , fx::re("$").on_string(not_match) )
+      .go<begin>();
+    fx::StaticParser<decltype(rule)> parse( move(rule) );
+
+    for_each(str.begin(), str.end()
+	     , [&](const string &str) {
+	       cout << "In " << str << "\n ";
+	       parse(str);
+	     });
+  }
+
+  {
+    namespace fx = grammar::fixed;
+    struct command;
+    int count = 0;
+
+    auto rule = fx::label<command>()
+      .branch( fx::re("^add(\\s*)(\\w*)").on_string( [&](const string &str) {
+	    cout << "got matching part: " << str << endl;
+	  }, 2)
+	, fx::re("^\\s+").ignore()
+	, fx::otherwise().re(".*").thunk( [&]() { ++count; })
+	).go<command>();
+    fx::StaticParser<decltype(rule)> parse( move(rule) );
+
+    parse("add element");
+    parse("   add root xyz");
+    cout << "unknown commands: " << count << endl;
+  }
+
   return 0 ;
 }
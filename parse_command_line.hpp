@@ -15,6 +15,24 @@
  */
 class brief_report;
 
+/**
+ * non-instantiable class, used for template key-ing.  Number of threads to parse on (0 to parse on the main thread).
+ */
+class parse_threads;
+
+/**
+ * non-instantiable classes, used for template key-ing.  File to keep a checkpoint of the parse in, so a run which dies
+ * can be started again where it left off, and lines between checkpoints (0 for the default).
+ */
+class checkpoint_file;
+class checkpoint_lines;
+
+/**
+ * non-instantiable class, used for template key-ing.  How the input is compressed, found from its first few bytes
+ * (grammar::Compression::none if it's plain XML).
+ */
+class input_compression;
+
 /**
  * prints out some help information then, regardless of other options, exits.
  * 
@@ -28,6 +46,9 @@ void print_help() {
        << "availible options:\n"
        << " --verbose [Branch|UntilGotoLabel|xml_grammar|xml_parser]\n"
        << " --summary : print summary of input stats rather than full json\n"
+       << " --threads=N : parse on N threads\n"
+       << " --checkpoint=FILE : keep a checkpoint in FILE, and resume from it if it's there\n"
+       << " --checkpoint-lines=N : lines between checkpoints (default 1000000)\n"
        << " -o (out-file-name|$): if out-file is not specified, but in-file is, out-file is set to in-file ~= s/\\.xml/\\.json/ \n"
        << " --help or -h: print this help and exit.\n"
        << "For usage please see Doxygen docs.\n"
@@ -94,6 +115,19 @@ void parse_command_line(std::istream*& input, std::unique_ptr<std::ifstream>& in
              /* summary option, which prints information about the parsed xml rather than the json form. */
 	    , re("--summary").thunk( bind(Singleton<bool,brief_report>::set,true) )
              
+             /* parse on several threads */
+	    , re("--threads=([0-9]+)").on_string( [](const string &n) {
+		Singleton<unsigned,parse_threads>::set( atoi(n.c_str()) );
+	      }, 1 ).go("command-line")
+
+             /* checkpoint the parse, to resume it if the run dies */
+	    , re("--checkpoint=(.+)").on_string( [](const string &name) {
+		Singleton<string,checkpoint_file>::set(name);
+	      }, 1 ).go("command-line")
+	    , re("--checkpoint-lines=([0-9]+)").on_string( [](const string &n) {
+		Singleton<unsigned,checkpoint_lines>::set( atoi(n.c_str()) );
+	      }, 1 ).go("command-line")
+
              /* prints a brief overview of options. */
 	    , re("--help").thunk( print_help )
 	    , re("-h").thunk( print_help )
@@ -142,6 +176,13 @@ void parse_command_line(std::istream*& input, std::unique_ptr<std::ifstream>& in
     input = &cin;
   }
 
+  /* compressed input is decompressed as it's read, rather than through zcat */
+  Compression compression = detect_compression(*input);
+  Singleton<Compression,input_compression>::set(compression);
+  if(compression == Compression::gzip) cout << "Input is gzip-compressed." << endl;
+  else if(compression == Compression::zlib) cout << "Input is zlib-compressed." << endl;
+  else if(compression == Compression::zstd) cout << "Input is zstd-compressed." << endl;
+
   /* if the user specifies a -o flag, but not an out_file name try to mangle the in_file_name and use that.  */
   if( out_file_name.empty() && use_infile_name_for_outfile ) {
     if(in_file_name.empty())
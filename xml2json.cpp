@@ -12,15 +12,21 @@
 
 #define DBG_GRAMMAR_BRANCH
 
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <functional>
 #include <deque>
+#include <stdexcept>
 #include <string>
 #include <functional>
 
 #include "./grammar/grammar.hpp"
 #include "./grammar/utility.hpp"
+#include "./grammar/Speculative.hpp"
+#include "./grammar/Pipeline.hpp"
+#include "./grammar/Decompress.hpp"
 
 #include "./XmlElement.hpp"
 #include "./XmlSemanticAction.hpp"
@@ -53,6 +59,18 @@
  *
  * --summary: prints a few statistics about the input XML file to std::cout
  *
+ * --threads=N: parse on N threads, in chunks starting at lines which begin with a tag (see grammar::SpeculativeParser)
+ *
+ * --checkpoint=FILE: every so many lines, save the state of the parse to FILE (see grammar::Parser::save_checkpoint).  If
+ *   FILE is there when xml2json starts, it resumes from it rather than starting over; it's removed once the parse is
+ *   done.  Elements which have closed are written once, to FILE.elements beside it, so FILE itself only holds the
+ *   open ones.  Needs an input file (not std::cin), and parses on one thread (--threads is ignored).
+ *
+ * --checkpoint-lines=N: lines between checkpoints (default 1000000)
+ *
+ * Input compressed with gzip or zlib (or zstd, if built with it) is decompressed as it's read, on the thread which reads
+ * ahead of the parser; it's recognised by its first few bytes, whatever it's called.  --threads isn't used with it.
+ *
  *
  * --help or -h: prints available options.
  *   
@@ -88,20 +106,20 @@ int main(int argc, char *argv[]) {
   /* set up some actions */
   XmlSemanticAction xml_action;
 
-  auto on_open = std::bind(&XmlSemanticAction::on_open, ref(xml_action), _1);
+  /* plain lambdas rather than std::bind; the grammar stores each by type and calls it directly */
+  auto on_open = [&xml_action](const string& str) { xml_action.on_open(str); };
   auto on_close = [&xml_action](const string& str) { xml_action.close(str); };
 
-  auto content = std::bind(&XmlSemanticAction::content, ref(xml_action), _1);
+  auto content = [&xml_action](const string& str) { xml_action.content(str); };
 
-  auto attribute_name = std::bind(&XmlSemanticAction::on_attribute_name, ref(xml_action), _1);
-  auto attribute_value = std::bind(&XmlSemanticAction::on_attribute_value, ref(xml_action), _1);
+  auto attribute_name = [&xml_action](const string& str) { xml_action.on_attribute_name(str); };
+  auto attribute_value = [&xml_action](const string& str) { xml_action.on_attribute_value(str); };
   
-  auto on_self_close = std::bind(&XmlSemanticAction::on_self_close, ref(xml_action));
+  auto on_self_close = [&xml_action]() { xml_action.on_self_close(); };
   
-  /* build my grammars.
-   * block scoped for automatic cleanups.
+  /* builds my grammars.  A function, since parsing on several threads (--threads) takes a copy for each thread.
    */
-  {
+  auto xml_grammar = [&]() -> DefineGrammar {
     DefineGrammar
       xml_rules			/* defines the parsing rules for XML*/
       , xml_in_tree;            /* as soon as I define a root element, I'm in tree and can't have a Declare */
@@ -154,27 +172,119 @@ int main(int argc, char *argv[]) {
 	       ).append( xml_in_tree );
     //<end xml_rules>********************
 
-    xml_parser.sink( xml_rules ); /* set the parser to caputre my grammar before the
-					Define objects are destroyed*/
+    return xml_rules;
+  };
 
-    if( RunVerbose<debug_xml_grammar>::P() ) {
-      /*** Print out current grammar ****/
-      cout<<"My grammar: "<<endl;
-      xml_parser.print(cout);
-      cout<<endl;
+  xml_parser.sink( xml_grammar() );
+
+  if( RunVerbose<debug_xml_grammar>::P() ) {
+    /*** Print out current grammar ****/
+    cout<<"My grammar: "<<endl;
+    xml_parser.print(cout);
+    cout<<endl;
+  }
+
+  string checkpoint_name = Singleton<string,checkpoint_file>::get();
+  unsigned checkpoint_every = Singleton<unsigned,checkpoint_lines>::get();
+  if(!checkpoint_every) checkpoint_every = 1000000;
+
+  /* elements closed between checkpoints, appended as they go (see XmlSemanticAction::save) */
+  string tree_log_name = checkpoint_name + ".elements";
+  fstream tree_log;
+
+  /* write a checkpoint of the parse so far, beside the last one until it's complete; offset is where the next line
+     starts in the input */
+  auto save_checkpoint = [&](streamoff offset) {
+    if(offset < 0) return;	/* reading a pipe */
+
+    string part = checkpoint_name + ".part";
+    {
+      ofstream out(part.c_str(), ios::binary);
+      xml_parser.save_checkpoint(out, offset, [&](ostream &out) { xml_action.save(out, tree_log); });
+      if(!tree_log) throw runtime_error("couldn't write " + tree_log_name);
+      if(!out) throw runtime_error("couldn't write checkpoint " + part);
     }
+    if( rename(part.c_str(), checkpoint_name.c_str()) )
+      throw runtime_error("couldn't replace checkpoint " + checkpoint_name);
+  };
+
+  ifstream resume;
+  if( !checkpoint_name.empty() ) {
+    resume.open(checkpoint_name.c_str(), ios::binary);
+    tree_log.open(tree_log_name.c_str()
+		  , ios::in | ios::out | ios::binary | (resume.is_open() ? ios::openmode() : ios::trunc));
+    xml_action.checkpointing(true);
   }
 
-  /* start off the seek for parser */
-  (*input_stream) >> ws;
+  Compression compression = Singleton<Compression,input_compression>::get();
+  streamoff skip = 0;		/* decompressed characters to pass over, resuming compressed input */
 
   try {  
-    /* pass each line of input to the parser */
-    foreach_line(*input_stream
-		 , [&](std::string& input) {
-		   xml_parser(input);  /* parse the current string, */
-		   xml_action.line_end(); /* increment the line count. */
-		 });
+    if( resume.is_open() ) {
+      /* a run which died left a checkpoint: carry on from there */
+      streamoff offset = xml_parser.restore_checkpoint(resume, [&](istream &in) { xml_action.load(in, tree_log); });
+      tree_log.seekp( tree_log.tellg() ); /* past the elements the checkpoint holds */
+      if(compression != Compression::none) skip = offset;
+      else if( !input_stream->seekg(offset) ) throw runtime_error("couldn't seek the input to the checkpoint");
+      cout << "Resuming from " << checkpoint_name << " at line " << xml_action.get_line() << "." << endl;
+    }
+    else if(compression == Compression::none)
+      /* start off the seek for parser */
+      (*input_stream) >> ws;
+
+    unsigned threads = Singleton<unsigned,parse_threads>::get();
+    if(threads && compression != Compression::none) {
+      cout << "Parsing compressed input on one thread." << endl;
+      threads = 0;
+    }
+    if(threads && !checkpoint_name.empty()) {
+      /* only the single-threaded parse saves checkpoints, or resumes from them */
+      cout << "Checkpointing on one thread." << endl;
+      threads = 0;
+    }
+    if(threads) {
+      /* chunks begin at lines starting with a tag, guessing the parser is between elements there */
+      SpeculativeParser parse(xml_grammar, "in-tree"
+			      , [](const char *begin, const char *end) {
+				while(begin < end && isspace( (unsigned char)*begin )) ++begin;
+				return begin < end && *begin == '<';
+			      }, threads);
+      parse.on_line( [&]() { xml_action.line_end(); } );
+      parse(*input_stream);
+    }
+    else {
+      /* pass each line of input to the parser, reading (and decompressing) ahead on another thread.  Offsets into
+	 compressed input count decompressed characters from the first which isn't a space. */
+      DecompressSource decompress(*input_stream, compression);
+      bool leading = compression != Compression::none;
+      streamoff start = leading ? skip : streamoff( input_stream->tellg() );
+      InputPipeline read( [&](char *data, size_t size) -> size_t {
+	  for(;;) {
+	    size_t n = decompress(data, size), from = 0;
+	    while( leading && from < n && isspace( (unsigned char)data[from] ) ) ++from; /* as >> ws does for plain input */
+	    if(from < n) leading = false;
+	    size_t parsed = min<size_t>(n - from, skip); /* by the run which left the checkpoint */
+	    from += parsed;
+	    skip -= parsed;
+	    if(from < n || !n) {
+	      memmove(data, data + from, n - from);
+	      return n - from;
+	    }
+	  }
+	});
+      read.foreach_line( [&](std::string& input) {
+	  xml_parser(input);  /* parse the current string, */
+	  xml_action.line_end(); /* increment the line count. */
+	  if( !checkpoint_name.empty() && xml_action.get_line() % checkpoint_every == 0 )
+	    save_checkpoint(start < 0 ? start : start + streamoff( read.offset() ));
+	});
+    }
+
+    /* finished: the next run starts over */
+    if( !checkpoint_name.empty() ) {
+      remove( checkpoint_name.c_str() );
+      remove( tree_log_name.c_str() );
+    }
     
   } catch(SyntaxError &e) {
     cout << "Line " << xml_action.get_line() << ": Syntax Error. " << e.what() << endl;
@@ -182,6 +292,9 @@ int main(int argc, char *argv[]) {
   } catch(XmlException &e) {
     cout << "Line " << xml_action.get_line() << ": Unbalanced tags " << e.what() << endl;
     return 1;
+  } catch(runtime_error &e) {
+    cout << "Line " << xml_action.get_line() << ": " << e.what() << endl;
+    return 1;
   }
 
   cout << "XML File looks OK.  Printing collected element information. \n\n" << endl;